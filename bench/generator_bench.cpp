@@ -0,0 +1,381 @@
+// Micro-benchmarks for the generator add-on (cpp/generator.cpp).
+//
+// Standalone executable, built against the AngelScript SDK with the generator
+// add-on copied to add_on/generator, for example:
+//
+//  g++ -O2 -std=c++11 -I<sdk>/angelscript/include -I<sdk>/add_on bench/generator_bench.cpp
+//      <sdk>/add_on/generator/generator.cpp <sdk>/add_on/scriptany/scriptany.cpp
+//      <sdk>/add_on/scriptarray/scriptarray.cpp <sdk>/add_on/scriptdictionary/scriptdictionary.cpp
+//      <sdk>/add_on/scriptstdstring/scriptstdstring*.cpp -L<sdk>/angelscript/lib -langelscript -lpthread
+//
+// Each benchmark prints one JSON object per line (machine readable):
+//  {"benchmark":"next_int64","iterations":1000000,"ns_per_op":25.1,"allocs_per_op":0.000,"relative":2.31}
+// allocs_per_op counts both C++ allocations (operator new) and engine allocations
+// (engine memory functions); relative is the time per op relative to the plain
+// script function call benchmark (script_call).
+//
+// Steady-state yield/next round trips must not allocate: for the next_* benchmarks
+// marked as checked, a check line is printed and the exit code is 1 on failure:
+//  {"check":"next_int64_allocation_free","iterations":1000000,"allocations":0,"passed":true}
+// The same check is done for create/next/free cycles of generators in an arena 
+// (CGeneratorArena), after warmup.
+//
+// usage: generator_bench [iterations] (1000000 by default)
+
+#include <angelscript.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include "scriptstdstring/scriptstdstring.h"
+#include "scriptarray/scriptarray.h"
+#include "scriptdictionary/scriptdictionary.h"
+#include "scriptany/scriptany.h"
+#include "generator/generator.h"
+
+#ifdef AS_USE_NAMESPACE
+using namespace AngelScript;
+#endif
+
+// allocations counter (C++ and engine)
+static std::atomic<unsigned long long> numAllocations(0);
+
+void* operator new(std::size_t size)
+{
+    numAllocations++;
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+static void* CountingAlloc(size_t size)
+{
+    numAllocations++;
+    return malloc(size);
+}
+
+static void CountingFree(void* ptr)
+{
+    free(ptr);
+}
+
+static const char* kScript =
+    "class Obj {}\n"
+    "int64 plainCall() { return 1; }\n"
+    "void empty(dictionary@ args) {}\n"
+    "void voidGen(dictionary@ args) { while (true) yield(); }\n"
+    "void intGen(dictionary@ args) { int64 i = 0; while (true) yield(i++); }\n"
+    "void doubleGen(dictionary@ args) { double d = 0; while (true) { yield(d); d += 1; } }\n"
+    "void handleGen(dictionary@ args) { Obj o; while (true) yield(@o); }\n"
+    "void nested(dictionary@ args) {\n"
+    "  int depth = int(args['depth']);\n"
+    "  if (depth <= 0) { int64 i = 0; while (true) yield(i++); }\n"
+    "  else yieldFrom(makeNested(depth - 1));\n"
+    "}\n"
+    "generator@ makeVoid() { return createGenerator(voidGen, null); }\n"
+    "generator@ makeInt() { return createGenerator(intGen, null); }\n"
+    "generator@ makeDouble() { return createGenerator(doubleGen, null); }\n"
+    "generator@ makeHandle() { return createGenerator(handleGen, null); }\n"
+    "typedGenerator<int64>@ makeTypedInt() { return typedGenerator<int64>(intGen, null); }\n"
+    "typedGenerator<double>@ makeTypedDouble() { return typedGenerator<double>(doubleGen, null); }\n"
+    "typedGenerator<Obj@>@ makeTypedHandle() { return typedGenerator<Obj@>(handleGen, null); }\n"
+    "generator@ makeNested(int depth) { dictionary args = {{'depth', depth}}; return createGenerator(nested, args); }\n"
+    "void createLoop(int n) { for (int i = 0; i < n; i++) createGenerator(empty, null); }\n"
+    "void callLoop(int n) { for (int i = 0; i < n; i++) empty(null); }\n"
+    "void arenaGen() { int64 i = 0; while (true) yield(i++); }\n";
+
+// time and allocations of a benchmark run
+class BenchmarkTimer
+{
+public:
+    BenchmarkTimer() :
+        allocations(numAllocations.load()),
+        start(std::chrono::steady_clock::now())
+    {
+    }
+
+    // allocations since the start of the benchmark
+    unsigned long long GetAllocations() const
+    {
+        return numAllocations.load() - allocations;
+    }
+
+    // prints the result of the benchmark, returns the time per op in ns
+    double Report(const char* name, unsigned long long iterations, double baseline) const
+    {
+        double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        unsigned long long allocs = numAllocations.load() - allocations;
+        double nsPerOp = iterations > 0 ? ns / double(iterations) : 0;
+        double allocsPerOp = iterations > 0 ? double(allocs) / double(iterations) : 0;
+        printf("{\"benchmark\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.3f,\"relative\":%.2f}\n",
+            name, iterations, nsPerOp, allocsPerOp, baseline > 0 ? nsPerOp / baseline : 1.0);
+        fflush(stdout);
+        return nsPerOp;
+    }
+protected:
+    unsigned long long                      allocations;
+    std::chrono::steady_clock::time_point   start;
+};
+
+static void MessageCallback(const asSMessageInfo* msg, void*)
+{
+    const char* type = msg->type == asMSGTYPE_ERROR ? "ERR " : (msg->type == asMSGTYPE_WARNING ? "WARN" : "INFO");
+    fprintf(stderr, "%s (%d, %d) : %s : %s\n", msg->section, msg->row, msg->col, type, msg->message);
+}
+
+// calls a script function returning a generator (with a reference for the caller)
+static CGenerator* MakeGenerator(asIScriptContext* ctx, asIScriptModule* module, const char* decl, int arg=-1)
+{
+    CGenerator* generator = NULL;
+    asIScriptFunction* func = module->GetFunctionByDecl(decl);
+    if (func && ctx->Prepare(func) >= 0)
+    {
+        if (arg >= 0)
+            ctx->SetArgDWord(0, asDWORD(arg));
+        if (ctx->Execute() == asEXECUTION_FINISHED)
+        {
+            generator = reinterpret_cast<CGenerator*>(ctx->GetReturnObject());
+            if (generator)
+                generator->AddRef();
+        }
+    }
+    if (generator == NULL)
+    {
+        fprintf(stderr, "failed to create generator: %s\n", decl);
+        exit(1);
+    }
+    return generator;
+}
+
+// calls a script loop function (int n)
+static void RunScriptLoop(asIScriptContext* ctx, asIScriptModule* module, const char* decl, int n)
+{
+    ctx->Prepare(module->GetFunctionByDecl(decl));
+    ctx->SetArgDWord(0, asDWORD(n));
+    ctx->Execute();
+}
+
+// number of failed checks (exit code)
+static int numFailedChecks = 0;
+
+// next() round trip on a generator created by the script function decl
+// allocationFree: checks that the round trips do not allocate after warmup
+static void BenchmarkNext(const char* name, asIScriptContext* ctx, asIScriptModule* module, const char* decl,
+    unsigned long long iterations, double baseline, bool allocationFree, CGeneratorGCPolicy* gcPolicy=NULL)
+{
+    CGenerator* generator = MakeGenerator(ctx, module, decl);
+    if (gcPolicy)
+        generator->SetGCPolicy(gcPolicy);
+    // warmup: first resume and value containers
+    for (int i = 0; i < 16; i++)
+        generator->Next();
+
+    BenchmarkTimer timer;
+    for (unsigned long long i = 0; i < iterations; i++)
+        generator->Next();
+    unsigned long long allocations = timer.GetAllocations();
+    timer.Report(name, iterations, baseline);
+    generator->Release();
+
+    if (allocationFree)
+    {
+        bool passed = allocations == 0;
+        printf("{\"check\":\"%s_allocation_free\",\"iterations\":%llu,\"allocations\":%llu,\"passed\":%s}\n",
+            name, iterations, allocations, passed ? "true" : "false");
+        fflush(stdout);
+        if (!passed)
+            numFailedChecks++;
+    }
+}
+
+// create/next/free cycles of generators in an arena (allocation free after warmup)
+// valueType: typedGenerator<T> instance (NULL for untyped generators)
+static void BenchmarkArena(const char* name, asIScriptEngine* engine, asIScriptModule* module, asITypeInfo* valueType,
+    unsigned long long iterations, double baseline)
+{
+    static const int kNumNext = 4;
+    asIScriptFunction* func = module->GetFunctionByDecl("void arenaGen()");
+    CGeneratorGCPolicy gcDeferred(CGeneratorGCPolicy::kGCDeferred);
+    CGeneratorArena arena(engine, 4, &gcDeferred);
+    arena.Warmup(func);
+
+    unsigned long long numCycles = iterations / kNumNext > 0 ? iterations / kNumNext : 1;
+    unsigned long long numFailures = 0;
+    unsigned long long allocations = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        // first pass: warmup (not checked)
+        unsigned long long count = pass == 0 ? 16 : numCycles;
+        BenchmarkTimer timer;
+        for (unsigned long long i = 0; i < count; i++)
+        {
+            CGenerator* generator = arena.Create(func, 0, NULL, NULL, valueType);
+            if (generator == NULL)
+            {
+                numFailures++;
+                continue;
+            }
+            for (int j = 0; j < kNumNext; j++)
+                generator->Next();
+            generator->Release();
+        }
+        if (pass == 1)
+        {
+            allocations = timer.GetAllocations();
+            timer.Report(name, numCycles, baseline);
+        }
+    }
+    gcDeferred.Collect(engine);
+
+    bool passed = allocations == 0 && numFailures == 0;
+    printf("{\"check\":\"%s_allocation_free\",\"iterations\":%llu,\"allocations\":%llu,\"failures\":%llu,\"passed\":%s}\n",
+        name, numCycles, allocations, numFailures, passed ? "true" : "false");
+    fflush(stdout);
+    if (!passed)
+        numFailedChecks++;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long long iterations = 1000000;
+    if (argc > 1)
+        iterations = strtoull(argv[1], NULL, 10);
+    if (iterations == 0)
+        iterations = 1;
+
+    asSetGlobalMemoryFunctions(CountingAlloc, CountingFree);
+
+    asIScriptEngine* engine = asCreateScriptEngine();
+    engine->SetMessageCallback(asFUNCTION(MessageCallback), 0, asCALL_CDECL);
+    RegisterStdString(engine);
+    RegisterScriptArray(engine, true);
+    RegisterScriptDictionary(engine);
+    RegisterScriptAny(engine);
+    RegisterGeneratorSupport(engine);
+
+    asIScriptModule* module = engine->GetModule("bench", asGM_ALWAYS_CREATE);
+    module->AddScriptSection("bench", kScript);
+    if (module->Build() < 0)
+    {
+        fprintf(stderr, "failed to build the benchmark script\n");
+        return 1;
+    }
+    asIScriptContext* ctx = engine->CreateContext();
+
+    // baseline: plain script function call from the host
+    asIScriptFunction* plainCall = module->GetFunctionByDecl("int64 plainCall()");
+    for (int i = 0; i < 16; i++)
+    {
+        ctx->Prepare(plainCall);
+        ctx->Execute();
+    }
+    double baseline = 0;
+    {
+        BenchmarkTimer timer;
+        for (unsigned long long i = 0; i < iterations; i++)
+        {
+            ctx->Prepare(plainCall);
+            ctx->Execute();
+        }
+        baseline = timer.Report("script_call", iterations, 0);
+    }
+
+    // createGenerator cost, compared to a call of the same function (both from a script loop)
+    int loopCount = int(iterations / 10 > 0 ? iterations / 10 : 1);
+    RunScriptLoop(ctx, module, "void callLoop(int)", 16);
+    {
+        BenchmarkTimer timer;
+        RunScriptLoop(ctx, module, "void callLoop(int)", loopCount);
+        timer.Report("script_call_in_script", loopCount, baseline);
+    }
+    RunScriptLoop(ctx, module, "void createLoop(int)", 16);
+    {
+        BenchmarkTimer timer;
+        RunScriptLoop(ctx, module, "void createLoop(int)", loopCount);
+        timer.Report("create_generator", loopCount, baseline);
+    }
+
+    // yield / next round trip
+    BenchmarkNext("next_void", ctx, module, "generator@ makeVoid()", iterations, baseline, true);
+    BenchmarkNext("next_int64", ctx, module, "generator@ makeInt()", iterations, baseline, true);
+    BenchmarkNext("next_double", ctx, module, "generator@ makeDouble()", iterations, baseline, true);
+    BenchmarkNext("next_handle", ctx, module, "generator@ makeHandle()", iterations, baseline, true);
+    BenchmarkNext("next_typed_int64", ctx, module, "typedGenerator<int64>@ makeTypedInt()", iterations, baseline, true);
+    BenchmarkNext("next_typed_double", ctx, module, "typedGenerator<double>@ makeTypedDouble()", iterations, baseline, true);
+    BenchmarkNext("next_typed_handle", ctx, module, "typedGenerator<Obj@>@ makeTypedHandle()", iterations, baseline, true);
+
+    // GC bookkeeping in DoNext: default policy (full cycle) compared to no collection
+    CGeneratorGCPolicy gcNever(CGeneratorGCPolicy::kGCNever);
+    BenchmarkNext("next_int64_gc_never", ctx, module, "generator@ makeInt()", iterations, baseline, true, &gcNever);
+
+    // arena generators: create, resume and free without allocating
+    BenchmarkArena("arena_cycle", engine, module, NULL, iterations, baseline);
+    BenchmarkArena("arena_cycle_typed_int64", engine, module, engine->GetTypeInfoByDecl("typedGenerator<int64>"), iterations, baseline);
+
+    // deep nesting (yieldFrom chains)
+    static const int kDepths[] = { 1, 8, 32 };
+    for (size_t d = 0; d < sizeof(kDepths) / sizeof(kDepths[0]); d++)
+    {
+        CGenerator* generator = MakeGenerator(ctx, module, "generator@ makeNested(int)", kDepths[d]);
+        for (int i = 0; i < 16; i++)
+            generator->Next();
+        char name[64];
+        snprintf(name, sizeof(name), "next_nested_%d", kDepths[d]);
+        BenchmarkTimer timer;
+        for (unsigned long long i = 0; i < iterations; i++)
+            generator->Next();
+        timer.Report(name, iterations, baseline);
+        generator->Release();
+    }
+
+    // 10k concurrent generators, resumed in turn
+    {
+        static const int kNumGenerators = 10000;
+        std::vector<CGenerator*> generators;
+        generators.reserve(kNumGenerators);
+        {
+            BenchmarkTimer timer;
+            for (int i = 0; i < kNumGenerators; i++)
+                generators.push_back(MakeGenerator(ctx, module, "generator@ makeInt()"));
+            timer.Report("create_10k_generators", kNumGenerators, baseline);
+        }
+        for (size_t i = 0; i < generators.size(); i++)
+            generators[i]->Next();
+
+        unsigned long long rounds = iterations / kNumGenerators > 0 ? iterations / kNumGenerators : 1;
+        BenchmarkTimer timer;
+        for (unsigned long long r = 0; r < rounds; r++)
+        {
+            for (size_t i = 0; i < generators.size(); i++)
+                generators[i]->Next();
+        }
+        timer.Report("next_10k_concurrent", rounds * kNumGenerators, baseline);
+
+        for (size_t i = 0; i < generators.size(); i++)
+            generators[i]->Release();
+    }
+
+    ctx->Release();
+    engine->ShutDownAndRelease();
+    return numFailedChecks > 0 ? 1 : 0;
+}
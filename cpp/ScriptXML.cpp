@@ -1,5 +1,13 @@
 #include "ScriptXML.h"
 #include <assert.h> // assert()
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <new>
 #include "tinyxml2/tinyxml2.h"
 #include "add_on/scriptdictionary/scriptdictionary.h"
 #include "add_on/scriptarray/scriptarray.h"
@@ -11,20 +19,168 @@ enum ASXMLNodeType
 {
     kXmlElement,
     kXmlComment,
-    kXmlText
+    kXmlText,
+    kXmlEndElement  // XmlReader only
+};
+
+static const asPWORD XML_CONTEXT=6680;
+
+// Per-engine XML context: types used when creating nodes, resolved once per engine
+struct ASXMLContext
+{
+    asITypeInfo*    nodeArrayType;  // array<XmlNode@>
+    asITypeInfo*    viewArrayType;  // array<XmlNodeView@>
+    int             stringTypeId;
+};
+
+static void CleanupXMLContext(asIScriptEngine* engine)
+{
+    delete reinterpret_cast<ASXMLContext*>(engine->GetUserData(XML_CONTEXT));
+}
+
+static ASXMLContext* GetXMLContext(asIScriptEngine* engine)
+{
+    ASXMLContext* context=reinterpret_cast<ASXMLContext*>(engine->GetUserData(XML_CONTEXT));
+    if (context == NULL)
+    {
+        context=new ASXMLContext();
+        context->nodeArrayType=engine->GetTypeInfoByDecl("array<XmlNode@>");
+        context->viewArrayType=engine->GetTypeInfoByDecl("array<XmlNodeView@>");
+        context->stringTypeId=engine->GetTypeIdByDecl("string");
+        engine->SetUserData(context, XML_CONTEXT);
+        engine->SetEngineUserDataCleanupCallback(CleanupXMLContext, XML_CONTEXT);
+    }
+    return context;
+}
+
+// Blocks of nodes created when parsing a document: nodes are allocated in consecutive
+// slots, and each block is freed as soon as its last node is released (each node holds a
+// reference to its block). Nodes of a subtree are allocated together (depth first), so a
+// subtree kept by a script after the root is released only keeps the few blocks its
+// nodes are in, not the whole document. The attributes and children containers of the
+// nodes are still allocated by their add-ons (their constructors are not accessible).
+class ASXMLNodeBlock
+{
+public:
+    // new block for numNodes nodes (with a reference for the allocator)
+    static ASXMLNodeBlock* Create(size_t nodeSize, size_t numNodes)
+    {
+        void* mem=asAllocMem(HeaderSize() + nodeSize * numNodes);
+        return new(mem) ASXMLNodeBlock(nodeSize, numNodes);
+    }
+
+    bool IsFull() const
+    {
+        return used == numNodes;
+    }
+
+    // memory for a new node (with a reference to the block)
+    void* Allocate()
+    {
+        refCount++;
+        return reinterpret_cast<char*>(this) + HeaderSize() + nodeSize * used++;
+    }
+
+    // not exposed
+    int refCount;
+    void AddRef()
+    {
+        refCount++;
+    }
+    void Release()
+    {
+        refCount--;
+        if(refCount==0)
+        {
+            this->~ASXMLNodeBlock();
+            asFreeMem(this);
+        }
+    }
+private:
+    ASXMLNodeBlock(size_t iNodeSize, size_t iNumNodes) :
+        refCount(1),
+        nodeSize(iNodeSize),
+        numNodes(iNumNodes),
+        used(0)
+    {
+    }
+    ~ASXMLNodeBlock()
+    {
+    }
+
+    // the nodes follow the header (aligned for any node member)
+    static size_t HeaderSize()
+    {
+        return (sizeof(ASXMLNodeBlock) + 15) & ~size_t(15);
+    }
+
+    size_t  nodeSize;
+    size_t  numNodes;
+    size_t  used;
+};
+
+// Allocator of the nodes of a document, used while converting it (blocks of growing size,
+// bounded so that a kept subtree does not retain too much memory)
+class ASXMLNodePool
+{
+public:
+    ASXMLNodePool(size_t iNodeSize) :
+        nodeSize(iNodeSize),
+        blockSize(0),
+        block(NULL)
+    {
+    }
+    ~ASXMLNodePool()
+    {
+        if (block)
+            block->Release();
+    }
+
+    // memory for a new node, and the block it belongs to (referenced by the node)
+    void* Allocate(ASXMLNodeBlock*& nodeBlock)
+    {
+        if (block == NULL || block->IsFull())
+        {
+            if (block)
+                block->Release();
+            blockSize = blockSize == 0 ? 64 : (blockSize < 1024 ? blockSize * 2 : blockSize);
+            block = ASXMLNodeBlock::Create(nodeSize, blockSize);
+        }
+        nodeBlock = block;
+        return block->Allocate();
+    }
+private:
+    size_t          nodeSize;
+    size_t          blockSize;
+    ASXMLNodeBlock* block;
 };
 
 class ASXMLNode
 {
 public:
-    ASXMLNode(asIScriptEngine* engine) :
+    ASXMLNode(asIScriptEngine* engine, const ASXMLContext* context=NULL) :
+        type(kXmlElement),
         attributes(NULL),
         children(NULL),
         refCount(1),
-        type(kXmlElement)
+        block(NULL)
     {
+        if (context == NULL)
+            context=GetXMLContext(engine);
         attributes=CScriptDictionary::Create(engine);
-        children=CScriptArray::Create(engine->GetTypeInfoByDecl("array<XmlNode@>"));
+        children=CScriptArray::Create(context->nodeArrayType);
+    }
+
+    // new node, allocated from the pool if any
+    static ASXMLNode* Create(asIScriptEngine* engine, const ASXMLContext* context, ASXMLNodePool* pool)
+    {
+        if (pool == NULL)
+            return new ASXMLNode(engine, context);
+        ASXMLNodeBlock* nodeBlock=NULL;
+        void* mem=pool->Allocate(nodeBlock);
+        ASXMLNode* node=new(mem) ASXMLNode(engine, context);
+        node->block=nodeBlock;
+        return node;
     }
 public:
     ASXMLNodeType       type;
@@ -34,6 +190,8 @@ public:
 
     // not exposed
     int refCount;
+    // block the node is allocated in (NULL for heap nodes)
+    ASXMLNodeBlock* block;
     void AddRef()
     {
         refCount++;
@@ -43,7 +201,14 @@ public:
         refCount--;
         if(refCount==0)
         {
-            delete this;
+            if (block)
+            {
+                ASXMLNodeBlock* nodeBlock=block;
+                this->~ASXMLNode();
+                nodeBlock->Release();
+            }
+            else
+                delete this;
         }
     }
 private:
@@ -56,41 +221,231 @@ private:
     }
 };
 
+static ASXMLNodeType GetTinyXMLNodeType(const XMLNode* node)
+{
+    if (node->ToComment())
+        return kXmlComment;
+    else if (node->ToText())
+        return kXmlText;
+    return kXmlElement;
+}
+
+// tinyxml2 document kept alive by the views over its nodes (lazy parse mode)
+class ASXMLDocument
+{
+public:
+    ASXMLDocument(asIScriptEngine* iEngine) :
+        engine(iEngine),
+        refCount(1)
+    {
+    }
+public:
+    XMLDocument         doc;
+    asIScriptEngine*    engine;
+
+    // not exposed
+    int refCount;
+    void AddRef()
+    {
+        refCount++;
+    }
+    void Release()
+    {
+        refCount--;
+        if(refCount==0)
+        {
+            delete this;
+        }
+    }
+private:
+    ~ASXMLDocument()
+    {
+    }
+};
+
+// Lightweight view over a node of a tinyxml2 document (XmlNodeView): nothing is copied 
+// until the script asks for it, and the attributes dictionary and the child nodes array 
+// are only materialized on first access.
+class ASXMLNodeView
+{
+public:
+    ASXMLNodeView(ASXMLDocument* iDocument, const XMLNode* iNode) :
+        refCount(1),
+        document(iDocument),
+        node(iNode),
+        attributes(NULL),
+        children(NULL),
+        childCount(-1)
+    {
+        document->AddRef();
+    }
+
+    ASXMLNodeType GetType() const
+    {
+        return GetTinyXMLNodeType(node);
+    }
+
+    std::string GetName() const
+    {
+        return node->Value();
+    }
+
+    // attribute value (defaultValue if not found), without materializing the attributes
+    std::string GetAttribute(const std::string& name, const std::string& defaultValue) const
+    {
+        const XMLElement* element = node->ToElement();
+        const char* value = element ? element->Attribute(name.c_str()) : NULL;
+        return value ? std::string(value) : defaultValue;
+    }
+
+    bool HasAttribute(const std::string& name) const
+    {
+        const XMLElement* element = node->ToElement();
+        return element != NULL && element->FindAttribute(name.c_str()) != NULL;
+    }
+
+    asUINT GetAttributeCount() const
+    {
+        asUINT count = 0;
+        const XMLElement* element = node->ToElement();
+        for (const XMLAttribute* attr = element ? element->FirstAttribute() : NULL; attr != NULL; attr = attr->Next())
+            count++;
+        return count;
+    }
+
+    // attributes dictionary, materialized on first access (new reference)
+    CScriptDictionary* GetAttributes()
+    {
+        if (attributes == NULL)
+        {
+            int stringTypeId = GetXMLContext(document->engine)->stringTypeId;
+            attributes = CScriptDictionary::Create(document->engine);
+            const XMLElement* element = node->ToElement();
+            for (const XMLAttribute* attr = element ? element->FirstAttribute() : NULL; attr != NULL; attr = attr->Next())
+            {
+                std::string value = attr->Value();
+                attributes->Set(attr->Name(), &value, stringTypeId);
+            }
+        }
+        attributes->AddRef();
+        return attributes;
+    }
+
+    // child nodes array (array<XmlNodeView@>), materialized on first access (new reference)
+    CScriptArray* GetChildNodes()
+    {
+        if (children == NULL)
+        {
+            children = CScriptArray::Create(GetXMLContext(document->engine)->viewArrayType);
+            children->Reserve(GetChildCount());
+            for (const XMLNode* child = node->ToElement() ? node->FirstChild() : NULL; child != NULL; child = child->NextSibling())
+            {
+                ASXMLNodeView* childView = new ASXMLNodeView(document, child);
+                children->InsertLast(&childView);
+                childView->Release();
+            }
+        }
+        children->AddRef();
+        return children;
+    }
+
+    // counted from the document, not from childNodes (which the script may modify)
+    asUINT GetChildCount() const
+    {
+        if (childCount < 0)
+        {
+            childCount = 0;
+            for (const XMLNode* child = node->ToElement() ? node->FirstChild() : NULL; child != NULL; child = child->NextSibling())
+                childCount++;
+        }
+        return asUINT(childCount);
+    }
+
+    // navigation without materializing the children (NULL if none)
+    ASXMLNodeView* GetFirstChild() const
+    {
+        const XMLNode* child = node->ToElement() ? node->FirstChild() : NULL;
+        return child ? new ASXMLNodeView(document, child) : NULL;
+    }
+
+    ASXMLNodeView* GetNextSibling() const
+    {
+        const XMLNode* sibling = node->NextSibling();
+        return sibling ? new ASXMLNodeView(document, sibling) : NULL;
+    }
+
+    // full copy of the subtree as an XmlNode
+    ASXMLNode* ToNode() const;
+
+    // not exposed
+    int refCount;
+    void AddRef()
+    {
+        refCount++;
+    }
+    void Release()
+    {
+        refCount--;
+        if(refCount==0)
+        {
+            delete this;
+        }
+    }
+private:
+    ~ASXMLNodeView()
+    {
+        if (attributes)
+            attributes->Release();
+        attributes=NULL;
+        if (children)
+            children->Release();
+        children=NULL;
+        document->Release();
+        document=NULL;
+    }
+
+    ASXMLDocument*      document;
+    const XMLNode*      node;
+    CScriptDictionary*  attributes;
+    CScriptArray*       children;
+    // number of children in the document (-1 until counted, the document is read-only)
+    mutable int         childCount;
+};
+
 // conversion
-static ASXMLNode* TinyXMLToASXML(const XMLNode* inNode,asIScriptEngine* engine,int stringTypeId)
+static ASXMLNode* TinyXMLToASXML(const XMLNode* inNode,asIScriptEngine* engine,const ASXMLContext* context,ASXMLNodePool* pool)
 {
     ASXMLNode* newNode=NULL;
     if (engine!=NULL && inNode != NULL)
     {
         // create new node and copy name & type
-        newNode=new ASXMLNode(engine);
+        newNode=ASXMLNode::Create(engine,context,pool);
         newNode->name=inNode->Value();
-        if(inNode->ToComment())
-            newNode->type=kXmlComment;
-        else if(inNode->ToText())
-            newNode->type=kXmlText;
-        else
+        newNode->type=GetTinyXMLNodeType(inNode);
+        if (newNode->type == kXmlElement)
         {
             const XMLElement* element = inNode->ToElement();
             if (element)
             {
-                newNode->type = kXmlElement;
-
                 // copy attributes
                 const XMLAttribute* attr = element->FirstAttribute();
                 while (attr != NULL)
                 {
                     const char* name = attr->Name();
                     std::string value = attr->Value();
-                    newNode->attributes->Set(name, &value, stringTypeId);
+                    newNode->attributes->Set(name, &value, context->stringTypeId);
                     attr = attr->Next();
                 }
 
-                // add children nodes
+                // add children nodes (allocating the array once)
+                asUINT childCount = 0;
+                for (const XMLNode* child = element->FirstChild(); child != NULL; child = child->NextSibling())
+                    childCount++;
+                newNode->children->Reserve(childCount);
                 const XMLNode* node = element->FirstChild();
                 while (node != NULL)
                 {
-                    ASXMLNode* childNode = TinyXMLToASXML(node, engine, stringTypeId);
+                    ASXMLNode* childNode = TinyXMLToASXML(node, engine, context, pool);
                     if (childNode)
                     {
                         newNode->children->InsertLast(&childNode);
@@ -180,11 +535,23 @@ static XMLNode* ASXMLToTinyXML(const ASXMLNode* element,XMLDocument* doc,int str
             newNode = newElement;
             break;
         }
+        case kXmlEndElement:
+        {
+            // XmlReader only: not part of a tree
+            break;
+        }
         }
     }
     return newNode;
 }
 
+// converts the document to a tree of nodes allocated from a document pool
+static ASXMLNode* ASXMLConvertDocument(const XMLDocument& doc,asIScriptEngine* engine)
+{
+    ASXMLNodePool pool(sizeof(ASXMLNode));
+    return TinyXMLToASXML(doc.RootElement(),engine,GetXMLContext(engine),&pool);
+}
+
 static ASXMLNode* ASXMLParseFile(const std::string& file)
 {
     XMLDocument doc;
@@ -197,7 +564,7 @@ static ASXMLNode* ASXMLParseFile(const std::string& file)
             asIScriptEngine* engine=currentContext->GetEngine();
             if (engine)
             {
-                return TinyXMLToASXML(doc.RootElement(),engine,engine->GetTypeIdByDecl("string"));
+                return ASXMLConvertDocument(doc,engine);
             }
         }
     }
@@ -216,13 +583,673 @@ static ASXMLNode* ASXMLParse(const std::string& str)
             asIScriptEngine* engine=currentContext->GetEngine();
             if (engine)
             {
-                return TinyXMLToASXML(doc.RootElement(),engine,engine->GetTypeIdByDecl("string"));
+                return ASXMLConvertDocument(doc,engine);
             }
         }
     }
     return NULL;
 }
 
+ASXMLNode* ASXMLNodeView::ToNode() const
+{
+    ASXMLNodePool pool(sizeof(ASXMLNode));
+    return TinyXMLToASXML(node, document->engine, GetXMLContext(document->engine), &pool);
+}
+
+// lazy parse mode: the document is kept in memory and exposed as views
+static ASXMLNodeView* ASXMLCreateRootView(ASXMLDocument* document, bool ok)
+{
+    ASXMLNodeView* view = NULL;
+    if (ok && document->doc.RootElement())
+        view = new ASXMLNodeView(document, document->doc.RootElement());
+    document->Release();
+    return view;
+}
+
+static ASXMLNodeView* ASXMLParseFileView(const std::string& file)
+{
+    asIScriptContext * currentContext=asGetActiveContext();
+    if (currentContext)
+    {
+        asIScriptEngine* engine=currentContext->GetEngine();
+        if (engine)
+        {
+            ASXMLDocument* document=new ASXMLDocument(engine);
+            return ASXMLCreateRootView(document, document->doc.LoadFile(file.c_str())==XML_SUCCESS);
+        }
+    }
+    return NULL;
+}
+
+static ASXMLNodeView* ASXMLParseView(const std::string& str)
+{
+    asIScriptContext * currentContext=asGetActiveContext();
+    if (currentContext)
+    {
+        asIScriptEngine* engine=currentContext->GetEngine();
+        if (engine)
+        {
+            ASXMLDocument* document=new ASXMLDocument(engine);
+            return ASXMLCreateRootView(document, document->doc.Parse(str.c_str(), str.size())==XML_SUCCESS);
+        }
+    }
+    return NULL;
+}
+
+// Streaming pull parser (XmlReader): the file is read in fixed-size chunks and only the
+// current node is kept in memory, so memory does not depend on the size of the document.
+// Supports elements, attributes, text, CDATA and comments with the predefined and numeric
+// entities. Declarations, processing instructions and DOCTYPE are skipped.
+class ASXMLReader
+{
+public:
+    ASXMLReader(FILE* iFile, asUINT chunkSize) :
+        refCount(1),
+        file(iFile),
+        pos(0),
+        end(0),
+        bomChecked(false),
+        nodeType(kXmlElement),
+        depth(0),
+        currentDepth(0),
+        isEmptyElement(false),
+        numAttributes(0),
+        hasNode(false),
+        error(false)
+    {
+        buffer.resize(chunkSize < 256 ? 256 : chunkSize);
+    }
+
+    // moves to the next node. Returns false at the end of the document or on error
+    bool Read()
+    {
+        return ReadNode(false);
+    }
+
+    // skips the children of the current element: the reader is positioned on its end 
+    // element (nothing is done for other nodes and empty elements)
+    void SkipSubtree()
+    {
+        if (hasNode && nodeType == kXmlElement && !isEmptyElement)
+        {
+            asUINT targetDepth = depth;
+            while (ReadNode(true))
+            {
+                if (nodeType == kXmlEndElement && depth == targetDepth)
+                    break;
+            }
+        }
+    }
+
+    ASXMLNodeType GetNodeType() const
+    {
+        return nodeType;
+    }
+
+    // element name, or content for text and comments (like XmlNode)
+    std::string GetName() const
+    {
+        return name;
+    }
+
+    asUINT GetDepth() const
+    {
+        return depth;
+    }
+
+    bool IsEmptyElement() const
+    {
+        return isEmptyElement;
+    }
+
+    asUINT GetAttributeCount() const
+    {
+        return numAttributes;
+    }
+
+    std::string GetAttributeName(asUINT index) const
+    {
+        return index < numAttributes ? attributes[index].first : std::string();
+    }
+
+    std::string GetAttribute(asUINT index) const
+    {
+        return index < numAttributes ? attributes[index].second : std::string();
+    }
+
+    std::string GetNamedAttribute(const std::string& attributeName, const std::string& defaultValue) const
+    {
+        for (asUINT i = 0; i < numAttributes; i++)
+        {
+            if (attributes[i].first == attributeName)
+                return attributes[i].second;
+        }
+        return defaultValue;
+    }
+
+    bool HasError() const
+    {
+        return error;
+    }
+
+    void Close()
+    {
+        if (file)
+            fclose(file);
+        file = NULL;
+        pos = end = 0;
+    }
+
+    // not exposed
+    int refCount;
+    void AddRef()
+    {
+        refCount++;
+    }
+    void Release()
+    {
+        refCount--;
+        if(refCount==0)
+        {
+            delete this;
+        }
+    }
+private:
+    ~ASXMLReader()
+    {
+        Close();
+    }
+
+    // reads the next chunk of the file
+    bool Fill()
+    {
+        if (file == NULL)
+            return false;
+        end = fread(&buffer[0], 1, buffer.size(), file);
+        pos = 0;
+
+        // skip the UTF-8 byte order mark at the start of the file (not a text node)
+        if (!bomChecked)
+        {
+            bomChecked = true;
+            if (end >= 3 && (unsigned char)buffer[0] == 0xEF && (unsigned char)buffer[1] == 0xBB && (unsigned char)buffer[2] == 0xBF)
+            {
+                pos = 3;
+                if (pos == end)
+                    return Fill();
+            }
+        }
+        return end > pos;
+    }
+
+    int Get()
+    {
+        if (pos == end && !Fill())
+            return -1;
+        return (unsigned char)buffer[pos++];
+    }
+
+    int Peek()
+    {
+        if (pos == end && !Fill())
+            return -1;
+        return (unsigned char)buffer[pos];
+    }
+
+    static bool IsSpace(int c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    void SkipSpaces()
+    {
+        while (IsSpace(Peek()))
+            pos++;
+    }
+
+    bool Fail()
+    {
+        error = true;
+        hasNode = false;
+        return false;
+    }
+
+    // reads until terminator (excluded). The content is only kept if keep is true
+    bool ReadUntil(const char* terminator, std::string& content, bool keep)
+    {
+        size_t length = strlen(terminator);
+        content.clear();
+        int c = 0;
+        while ((c = Get()) >= 0)
+        {
+            content.push_back(char(c));
+            if (content.size() >= length && content.compare(content.size() - length, length, terminator) == 0)
+            {
+                content.resize(content.size() - length);
+                return true;
+            }
+            if (!keep && content.size() > 64)
+                content.erase(0, content.size() - length);
+        }
+        return false;
+    }
+
+    void ReadName(std::string& content)
+    {
+        content.clear();
+        int c = Peek();
+        while (c >= 0 && !IsSpace(c) && c != '/' && c != '>' && c != '=')
+        {
+            content.push_back(char(c));
+            pos++;
+            c = Peek();
+        }
+    }
+
+    static void AppendUTF8(std::string& content, unsigned long code)
+    {
+        if (code < 0x80)
+            content.push_back(char(code));
+        else if (code < 0x800)
+        {
+            content.push_back(char(0xC0 | (code >> 6)));
+            content.push_back(char(0x80 | (code & 0x3F)));
+        }
+        else if (code < 0x10000)
+        {
+            content.push_back(char(0xE0 | (code >> 12)));
+            content.push_back(char(0x80 | ((code >> 6) & 0x3F)));
+            content.push_back(char(0x80 | (code & 0x3F)));
+        }
+        else
+        {
+            content.push_back(char(0xF0 | (code >> 18)));
+            content.push_back(char(0x80 | ((code >> 12) & 0x3F)));
+            content.push_back(char(0x80 | ((code >> 6) & 0x3F)));
+            content.push_back(char(0x80 | (code & 0x3F)));
+        }
+    }
+
+    // code point of a numeric entity (#nnn or #xhhh). Returns false if it is not a valid
+    // character (empty, not fully parsed, zero, surrogate or out of the Unicode range)
+    static bool DecodeCharacterReference(const std::string& entity, unsigned long& code)
+    {
+        bool hex = entity[1] == 'x' || entity[1] == 'X';
+        const char* digits = entity.c_str() + (hex ? 2 : 1);
+        if (hex ? !isxdigit((unsigned char)digits[0]) : !isdigit((unsigned char)digits[0]))
+            return false;
+        char* end = NULL;
+        code = strtoul(digits, &end, hex ? 16 : 10);
+        if (end == NULL || *end != 0)
+            return false;
+        return code > 0 && code <= 0x10FFFF && (code < 0xD800 || code > 0xDFFF);
+    }
+
+    // decodes predefined and numeric entities in place (invalid or unknown entities are kept)
+    static void DecodeEntities(std::string& content)
+    {
+        size_t amp = content.find('&');
+        if (amp == std::string::npos)
+            return;
+        std::string decoded(content, 0, amp);
+        unsigned long code = 0;
+        for (size_t i = amp; i < content.size(); i++)
+        {
+            size_t semicolon = std::string::npos;
+            if (content[i] == '&')
+                semicolon = content.find(';', i);
+            if (semicolon == std::string::npos || semicolon - i > 10)
+            {
+                decoded.push_back(content[i]);
+                continue;
+            }
+            std::string entity(content, i + 1, semicolon - i - 1);
+            if (entity == "lt") decoded.push_back('<');
+            else if (entity == "gt") decoded.push_back('>');
+            else if (entity == "amp") decoded.push_back('&');
+            else if (entity == "quot") decoded.push_back('"');
+            else if (entity == "apos") decoded.push_back('\'');
+            else if (entity.size() > 1 && entity[0] == '#' && DecodeCharacterReference(entity, code))
+            {
+                AppendUTF8(decoded, code);
+            }
+            else
+            {
+                decoded.append(content, i, semicolon - i + 1);
+            }
+            i = semicolon;
+        }
+        content.swap(decoded);
+    }
+
+    // parses the attributes and the end of a start tag
+    bool ReadStartTag(bool skipContent)
+    {
+        numAttributes = 0;
+        isEmptyElement = false;
+        while (true)
+        {
+            SkipSpaces();
+            int c = Get();
+            if (c == '>')
+                return true;
+            if (c == '/')
+            {
+                isEmptyElement = true;
+                return Get() == '>';
+            }
+            if (c < 0)
+                return false;
+            pos--;
+
+            // attribute: name = "value" (strings are reused from previous nodes)
+            if (numAttributes == attributes.size())
+                attributes.resize(numAttributes + 1);
+            std::pair<std::string, std::string>& attribute = attributes[numAttributes];
+            ReadName(attribute.first);
+            SkipSpaces();
+            if (attribute.first.empty() || Get() != '=')
+                return false;
+            SkipSpaces();
+            int quote = Get();
+            if (quote != '"' && quote != '\'')
+                return false;
+            const char terminator[2] = { char(quote), 0 };
+            if (!ReadUntil(terminator, attribute.second, !skipContent))
+                return false;
+            if (!skipContent)
+            {
+                DecodeEntities(attribute.second);
+                numAttributes++;
+            }
+        }
+    }
+
+    // reads the next node (skipContent: attributes and text are not kept, for SkipSubtree)
+    bool ReadNode(bool skipContent)
+    {
+        if (error)
+            return false;
+        numAttributes = 0;
+        isEmptyElement = false;
+        while (true)
+        {
+            int c = Get();
+            if (c < 0)
+            {
+                hasNode = false;
+                if (currentDepth > 0)
+                    error = true;
+                return false;
+            }
+            if (c != '<')
+            {
+                // text: whitespace only text between elements is ignored
+                name.assign(1, char(c));
+                bool whitespace = IsSpace(c);
+                while ((c = Peek()) >= 0 && c != '<')
+                {
+                    if (!skipContent)
+                        name.push_back(char(c));
+                    whitespace = whitespace && IsSpace(c);
+                    pos++;
+                }
+                if (whitespace)
+                    continue;
+                DecodeEntities(name);
+                nodeType = kXmlText;
+                depth = currentDepth;
+                hasNode = true;
+                return true;
+            }
+
+            c = Get();
+            if (c == '?')
+            {
+                // declaration or processing instruction
+                if (!ReadUntil("?>", name, false))
+                    return Fail();
+            }
+            else if (c == '!')
+            {
+                if (Peek() == '-')
+                {
+                    pos++;
+                    if (Get() != '-' || !ReadUntil("-->", name, !skipContent))
+                        return Fail();
+                    nodeType = kXmlComment;
+                    depth = currentDepth;
+                    hasNode = true;
+                    return true;
+                }
+                else if (Peek() == '[')
+                {
+                    pos++;
+                    if (!ReadUntil("[", name, true) || name != "CDATA" || !ReadUntil("]]>", name, !skipContent))
+                        return Fail();
+                    nodeType = kXmlText;
+                    depth = currentDepth;
+                    hasNode = true;
+                    return true;
+                }
+                else
+                {
+                    // DOCTYPE (with an optional internal subset)
+                    int brackets = 0;
+                    while ((c = Get()) >= 0 && (c != '>' || brackets > 0))
+                    {
+                        if (c == '[') brackets++;
+                        else if (c == ']') brackets--;
+                    }
+                    if (c < 0)
+                        return Fail();
+                }
+            }
+            else if (c == '/')
+            {
+                // the end of an element is reported at the depth of its start
+                ReadName(name);
+                SkipSpaces();
+                if (Get() != '>' || currentDepth == 0)
+                    return Fail();
+                currentDepth--;
+                nodeType = kXmlEndElement;
+                depth = currentDepth;
+                hasNode = true;
+                return true;
+            }
+            else
+            {
+                if (c < 0)
+                    return Fail();
+                pos--;
+                ReadName(name);
+                if (name.empty() || !ReadStartTag(skipContent))
+                    return Fail();
+                nodeType = kXmlElement;
+                depth = currentDepth;
+                if (!isEmptyElement)
+                    currentDepth++;
+                hasNode = true;
+                return true;
+            }
+        }
+    }
+
+    FILE*               file;
+    std::vector<char>   buffer;
+    size_t              pos;
+    size_t              end;
+    bool                bomChecked;
+
+    // current node
+    ASXMLNodeType       nodeType;
+    std::string         name;
+    asUINT              depth;
+    asUINT              currentDepth;
+    bool                isEmptyElement;
+    std::vector<std::pair<std::string, std::string> > attributes;
+    asUINT              numAttributes;
+    bool                hasNode;
+    bool                error;
+};
+
+static ASXMLReader* ASXMLOpenReader(const std::string& file, asUINT chunkSize)
+{
+    FILE* f=fopen(file.c_str(), "rb");
+    return f ? new ASXMLReader(f, chunkSize) : NULL;
+}
+
+// Streaming writer (XmlWriter): nodes are printed as the script writes them, to a
+// buffered file or to a string, without building a tree (memory only depends on depth).
+class ASXMLWriter
+{
+public:
+    // file: output file (owned), or NULL to write to a string
+    ASXMLWriter(FILE* iFile, bool compact) :
+        refCount(1),
+        file(iFile),
+        isStringWriter(iFile == NULL),
+        printer(iFile, compact),
+        compactMode(compact),
+        depth(0),
+        elementOpen(false),
+        closed(false)
+    {
+        printer.PushHeader(false, true);
+    }
+
+    bool StartElement(const std::string& name)
+    {
+        if (!IsOpen() || name.empty())
+            return false;
+
+        // the printer keeps a pointer to the name until the element is closed: keep a copy
+        // (a deque does not move its elements when growing, and names are reused)
+        if (depth < elementNames.size())
+            elementNames[depth] = name;
+        else
+            elementNames.push_back(name);
+        printer.OpenElement(elementNames[depth].c_str(), compactMode);
+        depth++;
+        elementOpen = true;
+        return true;
+    }
+
+    // attributes must be written right after StartElement
+    bool Attribute(const std::string& name, const std::string& value)
+    {
+        if (!IsOpen() || !elementOpen || name.empty())
+            return false;
+        printer.PushAttribute(name.c_str(), value.c_str());
+        return true;
+    }
+
+    bool Text(const std::string& text, bool cdata)
+    {
+        if (!IsOpen())
+            return false;
+        printer.PushText(text.c_str(), cdata);
+        elementOpen = false;
+        return true;
+    }
+
+    bool Comment(const std::string& comment)
+    {
+        if (!IsOpen())
+            return false;
+        printer.PushComment(comment.c_str());
+        elementOpen = false;
+        return true;
+    }
+
+    bool EndElement()
+    {
+        if (!IsOpen() || depth == 0)
+            return false;
+        printer.CloseElement(compactMode);
+        depth--;
+        elementOpen = false;
+        return true;
+    }
+
+    asUINT GetDepth() const
+    {
+        return depth;
+    }
+
+    // content written so far (string writers only)
+    std::string GetContent() const
+    {
+        return isStringWriter && printer.CStr() ? std::string(printer.CStr()) : std::string();
+    }
+
+    // ends all open elements and closes the file. Returns false if writing failed
+    bool Close()
+    {
+        while (depth > 0)
+            EndElement();
+        bool ok = true;
+        if (file)
+        {
+            ok = ferror(file) == 0;
+            ok = fclose(file) == 0 && ok;
+            file = NULL;
+        }
+        closed = true;
+        return ok;
+    }
+
+    // not exposed
+    int refCount;
+    void AddRef()
+    {
+        refCount++;
+    }
+    void Release()
+    {
+        refCount--;
+        if(refCount==0)
+        {
+            delete this;
+        }
+    }
+private:
+    ~ASXMLWriter()
+    {
+        Close();
+    }
+
+    bool IsOpen() const
+    {
+        return !closed;
+    }
+
+    FILE*       file;
+    bool        isStringWriter;
+    XMLPrinter  printer;
+    bool        compactMode;
+    // names of the open elements (up to depth)
+    std::deque<std::string> elementNames;
+    asUINT      depth;
+    bool        elementOpen;
+    bool        closed;
+};
+
+static ASXMLWriter* ASXMLOpenWriter(const std::string& file, bool compact)
+{
+    FILE* f=fopen(file.c_str(), "wb");
+    if (f == NULL)
+        return NULL;
+    setvbuf(f, NULL, _IOFBF, 1 << 16);
+    return new ASXMLWriter(f, compact);
+}
+
+static ASXMLWriter* ASXMLCreateStringWriter(bool compact)
+{
+    return new ASXMLWriter(NULL, compact);
+}
+
 // XML to text
 static bool ASXMLWriteFile(const ASXMLNode& node,const std::string& file,bool sortAttributes)
 {
@@ -234,7 +1261,7 @@ static bool ASXMLWriteFile(const ASXMLNode& node,const std::string& file,bool so
         asIScriptEngine* engine=currentContext->GetEngine();
         if (engine)
         {
-            XMLNode* elem=ASXMLToTinyXML(&node,&doc,engine->GetTypeIdByDecl("string"),sortAttributes);
+            XMLNode* elem=ASXMLToTinyXML(&node,&doc,GetXMLContext(engine)->stringTypeId,sortAttributes);
             if (elem)
             {
                 XMLDeclaration * decl = doc.NewDeclaration();
@@ -257,7 +1284,7 @@ static bool ASXMLWrite(ASXMLNode& node, std::string& content,bool sortAttributes
         asIScriptEngine* engine = currentContext->GetEngine();
         if (engine)
         {
-            XMLNode* elem = ASXMLToTinyXML(&node, &doc, engine->GetTypeIdByDecl("string"),sortAttributes);
+            XMLNode* elem = ASXMLToTinyXML(&node, &doc, GetXMLContext(engine)->stringTypeId,sortAttributes);
             if (elem)
             {
                 XMLDeclaration * decl = doc.NewDeclaration();
@@ -286,6 +1313,7 @@ static void RegisterScriptXML_Native(asIScriptEngine *engine)
     r = engine->RegisterEnumValue("XmlNodeType", "kXmlElement", kXmlElement);assert(r>=0);
     r = engine->RegisterEnumValue("XmlNodeType", "kXmlComment", kXmlComment);assert(r>=0);
     r = engine->RegisterEnumValue("XmlNodeType", "kXmlText", kXmlText);assert(r>=0);
+    r = engine->RegisterEnumValue("XmlNodeType", "kXmlEndElement", kXmlEndElement);assert(r>=0);
 
     // XMLNode class
     r = engine->RegisterObjectType("XmlNode",sizeof(ASXMLNode), asOBJ_REF); assert( r >= 0 );
@@ -297,9 +1325,60 @@ static void RegisterScriptXML_Native(asIScriptEngine *engine)
     r = engine->RegisterObjectProperty("XmlNode", "dictionary& attributes", asOFFSET(ASXMLNode, attributes)); assert( r >= 0 );
     r = engine->RegisterObjectProperty("XmlNode", "array<XmlNode@>& childNodes", asOFFSET(ASXMLNode, children)); assert( r >= 0 );
 
+    // XMLNodeView class (lazy parse mode)
+    r = engine->RegisterObjectType("XmlNodeView", 0, asOBJ_REF); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlNodeView", asBEHAVE_ADDREF, "void f()", asMETHODPR(ASXMLNodeView, AddRef, (void), void), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlNodeView", asBEHAVE_RELEASE, "void f()", asMETHODPR(ASXMLNodeView, Release, (void), void), asCALL_THISCALL);assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNodeType get_type() const", asMETHOD(ASXMLNodeView, GetType), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "string get_name() const", asMETHOD(ASXMLNodeView, GetName), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "string attribute(const string& name,const string& defaultValue=\"\") const", asMETHOD(ASXMLNodeView, GetAttribute), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "bool hasAttribute(const string& name) const", asMETHOD(ASXMLNodeView, HasAttribute), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "uint get_attributeCount() const", asMETHOD(ASXMLNodeView, GetAttributeCount), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "dictionary@ get_attributes()", asMETHOD(ASXMLNodeView, GetAttributes), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "array<XmlNodeView@>@ get_childNodes()", asMETHOD(ASXMLNodeView, GetChildNodes), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "uint get_childCount() const", asMETHOD(ASXMLNodeView, GetChildCount), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNodeView@ get_firstChild() const", asMETHOD(ASXMLNodeView, GetFirstChild), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNodeView@ get_nextSibling() const", asMETHOD(ASXMLNodeView, GetNextSibling), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNode@ toNode() const", asMETHOD(ASXMLNodeView, ToNode), asCALL_THISCALL); assert( r >= 0 );
+
+    // XmlReader class (streaming pull parser)
+    r = engine->RegisterObjectType("XmlReader", 0, asOBJ_REF); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlReader", asBEHAVE_ADDREF, "void f()", asMETHODPR(ASXMLReader, AddRef, (void), void), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlReader", asBEHAVE_RELEASE, "void f()", asMETHODPR(ASXMLReader, Release, (void), void), asCALL_THISCALL);assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "bool read()", asMETHOD(ASXMLReader, Read), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "void skipSubtree()", asMETHOD(ASXMLReader, SkipSubtree), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "XmlNodeType get_nodeType() const", asMETHOD(ASXMLReader, GetNodeType), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string get_name() const", asMETHOD(ASXMLReader, GetName), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "uint get_depth() const", asMETHOD(ASXMLReader, GetDepth), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "bool get_isEmptyElement() const", asMETHOD(ASXMLReader, IsEmptyElement), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "uint get_attributeCount() const", asMETHOD(ASXMLReader, GetAttributeCount), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string attributeName(uint index) const", asMETHOD(ASXMLReader, GetAttributeName), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string attribute(uint index) const", asMETHOD(ASXMLReader, GetAttribute), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string attribute(const string& name,const string& defaultValue=\"\") const", asMETHOD(ASXMLReader, GetNamedAttribute), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "bool get_error() const", asMETHOD(ASXMLReader, HasError), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "void close()", asMETHOD(ASXMLReader, Close), asCALL_THISCALL); assert( r >= 0 );
+
+    // XmlWriter class (streaming writer)
+    r = engine->RegisterObjectType("XmlWriter", 0, asOBJ_REF); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlWriter", asBEHAVE_ADDREF, "void f()", asMETHODPR(ASXMLWriter, AddRef, (void), void), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlWriter", asBEHAVE_RELEASE, "void f()", asMETHODPR(ASXMLWriter, Release, (void), void), asCALL_THISCALL);assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool startElement(const string& name)", asMETHOD(ASXMLWriter, StartElement), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool attribute(const string& name,const string& value)", asMETHOD(ASXMLWriter, Attribute), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool text(const string& text,bool cdata=false)", asMETHOD(ASXMLWriter, Text), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool comment(const string& comment)", asMETHOD(ASXMLWriter, Comment), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool endElement()", asMETHOD(ASXMLWriter, EndElement), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "uint get_depth() const", asMETHOD(ASXMLWriter, GetDepth), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "string get_content() const", asMETHOD(ASXMLWriter, GetContent), asCALL_THISCALL); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool close()", asMETHOD(ASXMLWriter, Close), asCALL_THISCALL); assert( r >= 0 );
+
     // XML functions
     r = engine->RegisterGlobalFunction("XmlNode@ XmlParseFile(const string& file)", asFUNCTIONPR(ASXMLParseFile, (const std::string&), ASXMLNode*), asCALL_CDECL); assert( r >= 0 );
     r = engine->RegisterGlobalFunction("XmlNode@ XmlParse(const string& str)", asFUNCTIONPR(ASXMLParse, (const std::string&), ASXMLNode*), asCALL_CDECL); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlNodeView@ XmlParseFileView(const string& file)", asFUNCTIONPR(ASXMLParseFileView, (const std::string&), ASXMLNodeView*), asCALL_CDECL); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlNodeView@ XmlParseView(const string& str)", asFUNCTIONPR(ASXMLParseView, (const std::string&), ASXMLNodeView*), asCALL_CDECL); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlReader@ XmlOpenReader(const string& file,uint chunkSize=65536)", asFUNCTIONPR(ASXMLOpenReader, (const std::string&, asUINT), ASXMLReader*), asCALL_CDECL); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlWriter@ XmlOpenWriter(const string& file,bool compact=false)", asFUNCTIONPR(ASXMLOpenWriter, (const std::string&, bool), ASXMLWriter*), asCALL_CDECL); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlWriter@ XmlCreateStringWriter(bool compact=true)", asFUNCTIONPR(ASXMLCreateStringWriter, (bool), ASXMLWriter*), asCALL_CDECL); assert( r >= 0 );
     r = engine->RegisterGlobalFunction("bool XmlWriteFile(const XmlNode& in xml,const string& file,bool sortAttributes=false)", asFUNCTIONPR(ASXMLWriteFile, (const ASXMLNode& node,const std::string&,bool), bool), asCALL_CDECL); assert( r >= 0 );
     r = engine->RegisterGlobalFunction("bool XmlWrite(const XmlNode& in xml,string& out str,bool sortAttributes=false)", asFUNCTIONPR(ASXMLWrite, (ASXMLNode& node,std::string&,bool), bool), asCALL_CDECL); assert( r >= 0 );
 }
@@ -312,6 +1391,7 @@ static void RegisterScriptXML_Generic(asIScriptEngine *engine)
     r = engine->RegisterEnumValue("XmlNodeType", "kXmlElement", kXmlElement);assert(r>=0);
     r = engine->RegisterEnumValue("XmlNodeType", "kXmlComment", kXmlComment);assert(r>=0);
     r = engine->RegisterEnumValue("XmlNodeType", "kXmlText", kXmlText);assert(r>=0);
+    r = engine->RegisterEnumValue("XmlNodeType", "kXmlEndElement", kXmlEndElement);assert(r>=0);
 
     // XMLNode class
     r = engine->RegisterObjectType("XmlNode",sizeof(ASXMLNode), asOBJ_REF); assert( r >= 0 );
@@ -323,9 +1403,60 @@ static void RegisterScriptXML_Generic(asIScriptEngine *engine)
     r = engine->RegisterObjectProperty("XmlNode", "dictionary& attributes", asOFFSET(ASXMLNode, attributes)); assert( r >= 0 );
     r = engine->RegisterObjectProperty("XmlNode", "array<XmlNode@>& childNodes", asOFFSET(ASXMLNode, children)); assert( r >= 0 );
 
+    // XMLNodeView class (lazy parse mode)
+    r = engine->RegisterObjectType("XmlNodeView", 0, asOBJ_REF); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlNodeView", asBEHAVE_ADDREF, "void f()", WRAP_MFN_PR(ASXMLNodeView, AddRef, (void), void), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlNodeView", asBEHAVE_RELEASE, "void f()", WRAP_MFN_PR(ASXMLNodeView, Release, (void), void), asCALL_GENERIC);assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNodeType get_type() const", WRAP_MFN(ASXMLNodeView, GetType), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "string get_name() const", WRAP_MFN(ASXMLNodeView, GetName), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "string attribute(const string& name,const string& defaultValue=\"\") const", WRAP_MFN(ASXMLNodeView, GetAttribute), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "bool hasAttribute(const string& name) const", WRAP_MFN(ASXMLNodeView, HasAttribute), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "uint get_attributeCount() const", WRAP_MFN(ASXMLNodeView, GetAttributeCount), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "dictionary@ get_attributes()", WRAP_MFN(ASXMLNodeView, GetAttributes), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "array<XmlNodeView@>@ get_childNodes()", WRAP_MFN(ASXMLNodeView, GetChildNodes), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "uint get_childCount() const", WRAP_MFN(ASXMLNodeView, GetChildCount), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNodeView@ get_firstChild() const", WRAP_MFN(ASXMLNodeView, GetFirstChild), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNodeView@ get_nextSibling() const", WRAP_MFN(ASXMLNodeView, GetNextSibling), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlNodeView", "XmlNode@ toNode() const", WRAP_MFN(ASXMLNodeView, ToNode), asCALL_GENERIC); assert( r >= 0 );
+
+    // XmlReader class (streaming pull parser)
+    r = engine->RegisterObjectType("XmlReader", 0, asOBJ_REF); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlReader", asBEHAVE_ADDREF, "void f()", WRAP_MFN_PR(ASXMLReader, AddRef, (void), void), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlReader", asBEHAVE_RELEASE, "void f()", WRAP_MFN_PR(ASXMLReader, Release, (void), void), asCALL_GENERIC);assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "bool read()", WRAP_MFN(ASXMLReader, Read), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "void skipSubtree()", WRAP_MFN(ASXMLReader, SkipSubtree), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "XmlNodeType get_nodeType() const", WRAP_MFN(ASXMLReader, GetNodeType), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string get_name() const", WRAP_MFN(ASXMLReader, GetName), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "uint get_depth() const", WRAP_MFN(ASXMLReader, GetDepth), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "bool get_isEmptyElement() const", WRAP_MFN(ASXMLReader, IsEmptyElement), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "uint get_attributeCount() const", WRAP_MFN(ASXMLReader, GetAttributeCount), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string attributeName(uint index) const", WRAP_MFN(ASXMLReader, GetAttributeName), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string attribute(uint index) const", WRAP_MFN(ASXMLReader, GetAttribute), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "string attribute(const string& name,const string& defaultValue=\"\") const", WRAP_MFN(ASXMLReader, GetNamedAttribute), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "bool get_error() const", WRAP_MFN(ASXMLReader, HasError), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlReader", "void close()", WRAP_MFN(ASXMLReader, Close), asCALL_GENERIC); assert( r >= 0 );
+
+    // XmlWriter class (streaming writer)
+    r = engine->RegisterObjectType("XmlWriter", 0, asOBJ_REF); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlWriter", asBEHAVE_ADDREF, "void f()", WRAP_MFN_PR(ASXMLWriter, AddRef, (void), void), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectBehaviour("XmlWriter", asBEHAVE_RELEASE, "void f()", WRAP_MFN_PR(ASXMLWriter, Release, (void), void), asCALL_GENERIC);assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool startElement(const string& name)", WRAP_MFN(ASXMLWriter, StartElement), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool attribute(const string& name,const string& value)", WRAP_MFN(ASXMLWriter, Attribute), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool text(const string& text,bool cdata=false)", WRAP_MFN(ASXMLWriter, Text), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool comment(const string& comment)", WRAP_MFN(ASXMLWriter, Comment), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool endElement()", WRAP_MFN(ASXMLWriter, EndElement), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "uint get_depth() const", WRAP_MFN(ASXMLWriter, GetDepth), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "string get_content() const", WRAP_MFN(ASXMLWriter, GetContent), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterObjectMethod("XmlWriter", "bool close()", WRAP_MFN(ASXMLWriter, Close), asCALL_GENERIC); assert( r >= 0 );
+
     // XML functions
     r = engine->RegisterGlobalFunction("XmlNode@ XmlParseFile(const string& file)", WRAP_FN_PR(ASXMLParseFile, (const std::string&), ASXMLNode*), asCALL_GENERIC); assert( r >= 0 );
     r = engine->RegisterGlobalFunction("XmlNode@ XmlParse(const string& str)", WRAP_FN_PR(ASXMLParse, (const std::string&), ASXMLNode*), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlNodeView@ XmlParseFileView(const string& file)", WRAP_FN_PR(ASXMLParseFileView, (const std::string&), ASXMLNodeView*), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlNodeView@ XmlParseView(const string& str)", WRAP_FN_PR(ASXMLParseView, (const std::string&), ASXMLNodeView*), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlReader@ XmlOpenReader(const string& file,uint chunkSize=65536)", WRAP_FN_PR(ASXMLOpenReader, (const std::string&, asUINT), ASXMLReader*), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlWriter@ XmlOpenWriter(const string& file,bool compact=false)", WRAP_FN_PR(ASXMLOpenWriter, (const std::string&, bool), ASXMLWriter*), asCALL_GENERIC); assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("XmlWriter@ XmlCreateStringWriter(bool compact=true)", WRAP_FN_PR(ASXMLCreateStringWriter, (bool), ASXMLWriter*), asCALL_GENERIC); assert( r >= 0 );
     r = engine->RegisterGlobalFunction("bool XmlWriteFile(const XmlNode& in xml,const string& file,bool sortAttributes=false)", WRAP_FN_PR(ASXMLWriteFile, (const ASXMLNode& node,const std::string&,bool), bool), asCALL_GENERIC); assert( r >= 0 );
     r = engine->RegisterGlobalFunction("bool XmlWrite(const XmlNode& in xml,string& out str,bool sortAttributes=false)", WRAP_FN_PR(ASXMLWrite, (ASXMLNode& node,std::string&,bool), bool), asCALL_GENERIC); assert( r >= 0 );
 }
@@ -336,6 +1467,9 @@ void RegisterScriptXML(asIScriptEngine * engine)
         RegisterScriptXML_Generic(engine);
     else
         RegisterScriptXML_Native(engine);
+
+    // resolve the types used by nodes once
+    GetXMLContext(engine);
 }
 END_AS_NAMESPACE
 
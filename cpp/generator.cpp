@@ -1,7 +1,12 @@
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <chrono>
+#include <new>
 
 #include "generator.h"
+#include "../scriptarray/scriptarray.h"
 
 using namespace std;
 
@@ -9,292 +14,3863 @@ BEGIN_AS_NAMESPACE
 
 static const asPWORD YIELD_IS_ALLOWED = 6666;
 static const asPWORD YIELD_GENERATOR=6667;
+static const asPWORD GENERATOR_CONTEXT_POOL=6668;
+static const asPWORD GENERATOR_GC_POLICY=6669;
+static const asPWORD GENERATOR_ENGINE_STATS=6670;
 
 static const int kYieldAllowedMagic = 321321321;
 
+CGeneratorContextPool::CGeneratorContextPool(asIScriptEngine* iEngine, asUINT iSize) :
+    engine(iEngine),
+    size(iSize),
+    numHits(0),
+    numMisses(0)
+{
+    // pre-warm the pool (reserve first so that returning contexts never allocates)
+    contexts.reserve(size);
+    for (asUINT i = 0; i < size; i++)
+    {
+        asIScriptContext* ctx = engine->CreateContext();
+        if (ctx == NULL)
+            break;
+        contexts.push_back(ctx);
+    }
+}
+
+CGeneratorContextPool::~CGeneratorContextPool()
+{
+    Clear();
+}
+
+asIScriptContext* CGeneratorContextPool::RequestContext()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!contexts.empty())
+        {
+            asIScriptContext* ctx = contexts.back();
+            contexts.pop_back();
+            numHits++;
+            return ctx;
+        }
+        numMisses++;
+    }
+    return engine->CreateContext();
+}
+
+void CGeneratorContextPool::ReturnContext(asIScriptContext* ctx)
+{
+    if (ctx)
+    {
+        // free any object still held by the context before it can be reused
+        // (a suspended context must be aborted first, unwinding its stack)
+        if (ctx->GetState() == asEXECUTION_SUSPENDED)
+            ctx->Abort();
+        ctx->Unprepare();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (contexts.size() < size)
+            {
+                contexts.push_back(ctx);
+                return;
+            }
+        }
+        ctx->Release();
+    }
+}
+
+void CGeneratorContextPool::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < contexts.size(); i++)
+    {
+        contexts[i]->Release();
+    }
+    contexts.clear();
+}
+
+asIScriptEngine* CGeneratorContextPool::GetEngine() const
+{
+    return engine;
+}
+
+asUINT CGeneratorContextPool::GetSize() const
+{
+    return size;
+}
+
+asUINT CGeneratorContextPool::GetNumAvailable() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return asUINT(contexts.size());
+}
+
+asUINT CGeneratorContextPool::GetNumHits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return numHits;
+}
+
+asUINT CGeneratorContextPool::GetNumMisses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return numMisses;
+}
+
+void CGeneratorContextPool::ResetStatistics()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    numHits = 0;
+    numMisses = 0;
+}
+
+CGeneratorContextPool* GetGeneratorContextPool(asIScriptEngine *engine)
+{
+    return reinterpret_cast<CGeneratorContextPool*>(engine->GetUserData(GENERATOR_CONTEXT_POOL));
+}
+
+static void CleanupGeneratorContextPool(asIScriptEngine *engine)
+{
+    CGeneratorContextPool* pool = GetGeneratorContextPool(engine);
+    delete pool;
+}
+
+void ShutdownGeneratorSupport(asIScriptEngine *engine)
+{
+    CGeneratorContextPool* pool = GetGeneratorContextPool(engine);
+    if (pool)
+        pool->Clear();
+}
+
+CGeneratorGCPolicy::CGeneratorGCPolicy(Mode iMode) :
+    mode(iMode),
+    maxStepsPerFrame(0),
+    maxMicrosecondsPerFrame(0),
+    frameSteps(0),
+    frameMicroseconds(0)
+{
+}
+
+CGeneratorGCPolicy::~CGeneratorGCPolicy()
+{
+}
+
+void CGeneratorGCPolicy::SetMode(Mode iMode)
+{
+    mode = iMode;
+}
+
+CGeneratorGCPolicy::Mode CGeneratorGCPolicy::GetMode() const
+{
+    return mode;
+}
+
+void CGeneratorGCPolicy::SetBudget(asUINT iMaxStepsPerFrame, asUINT iMaxMicrosecondsPerFrame)
+{
+    maxStepsPerFrame = iMaxStepsPerFrame;
+    maxMicrosecondsPerFrame = iMaxMicrosecondsPerFrame;
+}
+
+void CGeneratorGCPolicy::NewFrame()
+{
+    frameSteps = 0;
+    frameMicroseconds = 0;
+}
+
+bool CGeneratorGCPolicy::UsesGCStatistics() const
+{
+    return mode == kGCFullCycle;
+}
+
+asUINT CGeneratorGCPolicy::AfterExecute(asIScriptEngine* engine, asUINT numNewObjects)
+{
+    asUINT numDestroyed = 0;
+    switch (mode)
+    {
+    case kGCFullCycle:
+    {
+        // Destroy all known garbage if any new objects were created
+        if (numNewObjects > 0)
+            numDestroyed = Collect(engine);
+
+        // Just run an incremental step for detecting cyclic references
+        engine->GarbageCollect(asGC_ONE_STEP | asGC_DETECT_GARBAGE);
+        break;
+    }
+    case kGCBudget:
+    {
+        // no limit at all: just one incremental step per execution
+        if (maxStepsPerFrame == 0 && maxMicrosecondsPerFrame == 0)
+        {
+            engine->GarbageCollect(asGC_ONE_STEP | asGC_DESTROY_GARBAGE | asGC_DETECT_GARBAGE);
+            break;
+        }
+
+        // run incremental steps until the budget for this frame is consumed
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        double startMicroseconds = frameMicroseconds;
+        while ((maxStepsPerFrame == 0 || frameSteps < maxStepsPerFrame) &&
+            (maxMicrosecondsPerFrame == 0 || frameMicroseconds < maxMicrosecondsPerFrame))
+        {
+            int r = engine->GarbageCollect(asGC_ONE_STEP | asGC_DESTROY_GARBAGE | asGC_DETECT_GARBAGE);
+            frameSteps++;
+            if (maxMicrosecondsPerFrame != 0)
+                frameMicroseconds = startMicroseconds + std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+            // GC cycle completed: nothing left to do for now
+            if (r == 0)
+                break;
+        }
+        break;
+    }
+    case kGCNever:
+    case kGCDeferred:
+        break;
+    }
+    return numDestroyed;
+}
+
+asUINT CGeneratorGCPolicy::Collect(asIScriptEngine* engine)
+{
+    asUINT gcSizeBefore = 0, gcSizeAfter = 0;
+    engine->GetGCStatistics(&gcSizeBefore);
+    engine->GarbageCollect(asGC_FULL_CYCLE | asGC_DESTROY_GARBAGE);
+    engine->GetGCStatistics(&gcSizeAfter);
+    return gcSizeBefore > gcSizeAfter ? gcSizeBefore - gcSizeAfter : 0;
+}
+
+// default policy when none is set (stateless)
+static CGeneratorGCPolicy defaultGCPolicy;
+
+void SetGeneratorGCPolicy(asIScriptEngine *engine, CGeneratorGCPolicy* policy)
+{
+    engine->SetUserData(policy, GENERATOR_GC_POLICY);
+}
+
+CGeneratorGCPolicy* GetGeneratorGCPolicy(asIScriptEngine *engine)
+{
+    CGeneratorGCPolicy* policy = reinterpret_cast<CGeneratorGCPolicy*>(engine->GetUserData(GENERATOR_GC_POLICY));
+    if (policy == NULL)
+        policy = &defaultGCPolicy;
+    return policy;
+}
+
+// GC policy of the current thread (set for executor workers), overrides the engine policy
+static thread_local CGeneratorGCPolicy* threadGCPolicy = NULL;
+
+// context pool of the current thread (set for executor workers), overrides the engine pool
+static thread_local CGeneratorContextPool* threadContextPool = NULL;
+
+// memory accounting: memory functions, and the generator running on the current thread
+static asALLOCFUNC_t memoryAllocFunc = NULL;
+static asFREEFUNC_t memoryFreeFunc = NULL;
+static bool memoryAccounting = false;
+static thread_local SGeneratorMemoryStats* threadMemoryStats = NULL;
+
+// size stored before each block (keeps the alignment of the underlying allocator)
+static const size_t kMemoryHeaderSize = 16;
+
+static void* AccountingAlloc(size_t size)
+{
+    char* block = reinterpret_cast<char*>(memoryAllocFunc(size + kMemoryHeaderSize));
+    if (block == NULL)
+        return NULL;
+    *reinterpret_cast<size_t*>(block) = size;
+    if (threadMemoryStats)
+        threadMemoryStats->bytesAllocated += size;
+    return block + kMemoryHeaderSize;
+}
+
+static void AccountingFree(void* ptr)
+{
+    if (ptr == NULL)
+        return;
+    char* block = reinterpret_cast<char*>(ptr) - kMemoryHeaderSize;
+    if (threadMemoryStats)
+        threadMemoryStats->bytesFreed += *reinterpret_cast<size_t*>(block);
+    memoryFreeFunc(block);
+}
+
+int EnableGeneratorMemoryAccounting(asALLOCFUNC_t allocFunc, asFREEFUNC_t freeFunc)
+{
+    memoryAllocFunc = allocFunc ? allocFunc : malloc;
+    memoryFreeFunc = freeFunc ? freeFunc : free;
+    int r = asSetGlobalMemoryFunctions(AccountingAlloc, AccountingFree);
+    memoryAccounting = (r >= 0);
+    return r;
+}
+
+// arena used by the createGenerator overloads on the current thread (real-time threads)
+static thread_local CGeneratorArena* threadGeneratorArena = NULL;
+
+void SetGeneratorArenaForThread(CGeneratorArena* arena)
+{
+    threadGeneratorArena = arena;
+}
+
+// engine-wide statistics, updated by generators from any thread (times in nanoseconds)
+struct SGeneratorEngineStats
+{
+    std::atomic<asUINT>     numExecutions;
+    std::atomic<asUINT>     numYields;
+    std::atomic<asUINT>     numGCObjectsCreated;
+    std::atomic<asUINT>     numGCObjectsDestroyed;
+    std::atomic<asINT64>    totalTime;
+    std::atomic<asINT64>    maxTime;
+    std::atomic<asINT64>    gcTime;
+    std::chrono::steady_clock::time_point startTime;
+    std::atomic<bool>       enabled;
+
+    SGeneratorEngineStats() :
+        enabled(false)
+    {
+        Reset();
+    }
+    void Reset()
+    {
+        numExecutions = 0;
+        numYields = 0;
+        numGCObjectsCreated = 0;
+        numGCObjectsDestroyed = 0;
+        totalTime = 0;
+        maxTime = 0;
+        gcTime = 0;
+        startTime = std::chrono::steady_clock::now();
+    }
+};
+
+static SGeneratorEngineStats* GetEngineStats(asIScriptEngine *engine)
+{
+    return reinterpret_cast<SGeneratorEngineStats*>(engine->GetUserData(GENERATOR_ENGINE_STATS));
+}
+
+static void CleanupEngineStats(asIScriptEngine *engine)
+{
+    delete GetEngineStats(engine);
+}
+
+static double YieldsPerSecond(asUINT numYields, std::chrono::steady_clock::time_point start)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds > 0 ? numYields / seconds : 0;
+}
+
+SGeneratorStats GetGeneratorEngineStats(asIScriptEngine *engine)
+{
+    SGeneratorStats stats;
+    memset(&stats, 0, sizeof(stats));
+    SGeneratorEngineStats* engineStats = GetEngineStats(engine);
+    if (engineStats)
+    {
+        stats.numExecutions = engineStats->numExecutions;
+        stats.numYields = engineStats->numYields;
+        stats.numGCObjectsCreated = engineStats->numGCObjectsCreated;
+        stats.numGCObjectsDestroyed = engineStats->numGCObjectsDestroyed;
+        stats.totalTime = engineStats->totalTime / 1000.0;
+        stats.maxTime = engineStats->maxTime / 1000.0;
+        stats.gcTime = engineStats->gcTime / 1000.0;
+        stats.yieldsPerSecond = YieldsPerSecond(stats.numYields, engineStats->startTime);
+    }
+    return stats;
+}
+
+void ResetGeneratorEngineStats(asIScriptEngine *engine)
+{
+    SGeneratorEngineStats* engineStats = GetEngineStats(engine);
+    if (engineStats)
+        engineStats->Reset();
+}
+
+void EnableGeneratorStats(asIScriptEngine *engine, bool enable)
+{
+    SGeneratorEngineStats* engineStats = GetEngineStats(engine);
+    if (engineStats)
+    {
+        if (enable && !engineStats->enabled)
+            engineStats->Reset();
+        engineStats->enabled = enable;
+    }
+}
+
+// engine statistics to update (NULL if not enabled)
+static inline SGeneratorEngineStats* EnabledEngineStats(SGeneratorEngineStats* engineStats)
+{
+    return (engineStats && engineStats->enabled.load(std::memory_order_relaxed)) ? engineStats : NULL;
+}
+
+static SGeneratorStats ScriptGetGeneratorEngineStats()
+{
+    SGeneratorStats stats;
+    memset(&stats, 0, sizeof(stats));
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx)
+        stats = GetGeneratorEngineStats(ctx->GetEngine());
+    return stats;
+}
+
+// pool the contexts of new generators are requested from on this thread (NULL if none)
+static CGeneratorContextPool* GetContextPoolForThread(asIScriptEngine *engine)
+{
+    if (threadContextPool != NULL && threadContextPool->GetEngine() == engine)
+        return threadContextPool;
+    return GetGeneratorContextPool(engine);
+}
+
+static asIScriptContext* RequestContextForGenerator(asIScriptEngine *engine)
+{
+    CGeneratorContextPool* pool = GetContextPoolForThread(engine);
+    if (pool)
+        return pool->RequestContext();
+    return engine->RequestContext();
+}
+
+static void ReturnContextForGenerator(asIScriptContext *ctx, CGeneratorContextPool* pool = NULL)
+{
+    // a suspended context must be aborted to be unprepared (unwinding its stack)
+    if (ctx->GetState() == asEXECUTION_SUSPENDED)
+        ctx->Abort();
+
+    // Return the context to the given pool, the generator pool (or the engine if no pool)
+    ctx->SetUserData(NULL, YIELD_IS_ALLOWED);
+    ctx->SetUserData(NULL, YIELD_GENERATOR);
+    asIScriptEngine *engine = ctx->GetEngine();
+    if (pool == NULL)
+        pool = GetGeneratorContextPool(engine);
+    if (pool)
+        pool->ReturnContext(ctx);
+    else
+        engine->ReturnContext(ctx);
+}
+
+// Prepares a context to run a generator function (for delegates: the method with its object)
+static int PrepareContextForGenerator(asIScriptContext *coctx, asIScriptFunction *func)
+{
+    int r = 0;
+    if (func->GetFuncType() == asFUNC_DELEGATE)
+    {
+        r = coctx->Prepare(func->GetDelegateFunction());
+        if (r >= 0)
+            r = coctx->SetObject(func->GetDelegateObject());
+    }
+    else
+        r = coctx->Prepare(func);
+    if (r >= 0)
+        coctx->SetUserData((void*)&kYieldAllowedMagic, YIELD_IS_ALLOWED);
+    return r;
+}
+
+void CGeneratorContextPool::Warmup(asIScriptFunction* func)
+{
+    if (func == NULL)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < contexts.size(); i++)
+    {
+        if (PrepareContextForGenerator(contexts[i], func) >= 0)
+            contexts[i]->SetUserData(NULL, YIELD_IS_ALLOWED);
+        contexts[i]->Unprepare();
+    }
+}
+
 asIScriptContext * CreateContextForGenerator(asIScriptContext *currCtx, asIScriptFunction *func)
 {
-    asIScriptEngine *engine = currCtx->GetEngine();
-    asIScriptContext *coctx = engine->RequestContext();
-    if (coctx == 0)
+    asIScriptEngine *engine = currCtx->GetEngine();
+    asIScriptContext *coctx = RequestContextForGenerator(engine);
+    if (coctx == 0)
+    {
+        return 0;
+    }
+
+    if (PrepareContextForGenerator(coctx, func) < 0)
+    {
+        // Couldn't prepare the context
+        ReturnContextForGenerator(coctx);
+        return 0;
+    }
+    return coctx;
+}
+
+void* ScriptYieldObject(void *ref, int refTypeId)
+{
+    void* returnPointer=0;
+    // Get a pointer to the context that is currently being executed
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx)
+    {
+        void* data = ctx->GetUserData(YIELD_IS_ALLOWED);
+        if (data != NULL && (*reinterpret_cast<int*>(data) == kYieldAllowedMagic))
+        {
+            // get the generator
+            CGenerator* theGenerator = reinterpret_cast<CGenerator*>(ctx->GetUserData(YIELD_GENERATOR));
+            if (theGenerator)
+            {
+                // store value
+                if (!theGenerator->StoreValue(ref,refTypeId))
+                {
+                    ctx->SetException("Yielded value cannot be converted to the generator value type");
+                    return returnPointer;
+                }
+
+                // store return object - the trick is that the execution of the VM will be stopped AFTER we have returned
+                // so the return value has to be a valid object, always.
+                returnPointer = reinterpret_cast<void*>(theGenerator->NewYieldReturnPtr(ctx->GetEngine()));
+            }
+            // The current context must be suspended so that VM will return from
+            // the Next() method where the context manager will continue.
+            ctx->Suspend();
+        }
+        else
+        {
+            // throw error
+            ctx->SetException("Cannot call yield outside of a generator function");
+        }
+    }
+    return returnPointer;
+}
+
+void* ScriptYield()
+{
+    return ScriptYieldObject(NULL,0);
+}
+
+void* ScriptYieldInt(asINT64 &value)
+{
+    return	ScriptYieldObject(&value, asTYPEID_INT64);
+}
+
+void* ScriptYieldDouble(double &value)
+{
+    return	ScriptYieldObject(&value, asTYPEID_DOUBLE);
+}
+
+static CGenerator* CreateGenerator(asIScriptFunction *func, CScriptDictionary *arg, asITypeInfo *valueType)
+{
+    CGenerator* gen = 0;
+    if (func != 0)
+    {
+        asIScriptContext *ctx = asGetActiveContext();
+        if (ctx)
+        {
+            // Create a new context for the generator
+            asIScriptContext *coctx = CreateContextForGenerator(ctx, func);
+            if (coctx)
+            {
+                // Pass the argument to the context
+                coctx->SetArgObject(0, arg);
+
+                // The generator will call Execute() on this context when "Next" is called
+                gen = new CGenerator(coctx, valueType);
+            }
+        }
+    }
+    return gen;
+}
+
+void ScriptYieldFrom(void *ref, int refTypeId)
+{
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx)
+    {
+        void* data = ctx->GetUserData(YIELD_IS_ALLOWED);
+        CGenerator* theGenerator = reinterpret_cast<CGenerator*>(ctx->GetUserData(YIELD_GENERATOR));
+        if (data == NULL || *reinterpret_cast<int*>(data) != kYieldAllowedMagic || theGenerator == NULL)
+        {
+            ctx->SetException("Cannot call yieldFrom outside of a generator function");
+            return;
+        }
+
+        // accept generator and typedGenerator<T> objects only
+        asITypeInfo* type = ctx->GetEngine()->GetTypeInfoById(refTypeId);
+        if (type == NULL || (strcmp(type->GetName(), "generator") != 0 && strcmp(type->GetName(), "typedGenerator") != 0))
+        {
+            ctx->SetException("yieldFrom expects a generator");
+            return;
+        }
+        CGenerator* generator = (refTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<CGenerator**>(ref) : reinterpret_cast<CGenerator*>(ref);
+        if (generator == NULL)
+        {
+            ctx->SetException("Null generator passed to yieldFrom");
+            return;
+        }
+        if (!theGenerator->Delegate(generator))
+        {
+            ctx->SetException("Generator cannot be delegated to");
+            return;
+        }
+
+        // suspend: the delegate will be resumed directly by our caller
+        ctx->Suspend();
+    }
+}
+
+// returns the generator of the current context for wait functions (exception if none)
+static CGenerator* GetGeneratorForWait(asIScriptContext *ctx)
+{
+    void* data = ctx->GetUserData(YIELD_IS_ALLOWED);
+    CGenerator* theGenerator = reinterpret_cast<CGenerator*>(ctx->GetUserData(YIELD_GENERATOR));
+    if (data == NULL || *reinterpret_cast<int*>(data) != kYieldAllowedMagic || theGenerator == NULL)
+    {
+        ctx->SetException("Cannot wait outside of a generator function");
+        return NULL;
+    }
+    return theGenerator;
+}
+
+void ScriptWaitFor(double milliseconds)
+{
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx)
+    {
+        CGenerator* theGenerator = GetGeneratorForWait(ctx);
+        if (theGenerator)
+        {
+            theGenerator->WaitFor(milliseconds);
+            ctx->Suspend();
+        }
+    }
+}
+
+void ScriptWaitUntilSample(asINT64 samplePosition)
+{
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx)
+    {
+        CGenerator* theGenerator = GetGeneratorForWait(ctx);
+        if (theGenerator)
+        {
+            theGenerator->WaitUntilSample(samplePosition);
+            ctx->Suspend();
+        }
+    }
+}
+
+CGenerator* ScriptCreateGenerator(asIScriptFunction *func, CScriptDictionary *arg)
+{
+    return CreateGenerator(func, arg, NULL);
+}
+
+CGenerator* ScriptCreateTypedGenerator(asITypeInfo *type, asIScriptFunction *func, CScriptDictionary *arg)
+{
+    return CreateGenerator(func, arg, type);
+}
+
+const void* ScriptGetTypedValue(const CGenerator *gen)
+{
+    const void* valuePtr = gen->GetTypedValue();
+    if (valuePtr == NULL)
+    {
+        asIScriptContext *ctx = asGetActiveContext();
+        if (ctx)
+            ctx->SetException("Generator value is not available");
+    }
+    return valuePtr;
+}
+
+// conversion between primitive types (including enums) for typed generators
+static bool IsPrimitiveTypeId(int typeId)
+{
+    return typeId > asTYPEID_VOID && (typeId & (asTYPEID_MASK_OBJECT | asTYPEID_OBJHANDLE)) == 0;
+}
+
+static bool ConvertPrimitiveValue(const void *src, int srcTypeId, void *dst, int dstTypeId)
+{
+    asINT64 i = 0;
+    double  d = 0;
+    bool    isFloat = false;
+    switch (srcTypeId)
+    {
+    case asTYPEID_BOOL: i = *reinterpret_cast<const bool*>(src) ? 1 : 0; break;
+    case asTYPEID_INT8: i = *reinterpret_cast<const signed char*>(src); break;
+    case asTYPEID_INT16: i = *reinterpret_cast<const short*>(src); break;
+    case asTYPEID_INT32: i = *reinterpret_cast<const int*>(src); break;
+    case asTYPEID_INT64: i = *reinterpret_cast<const asINT64*>(src); break;
+    case asTYPEID_UINT8: i = *reinterpret_cast<const asBYTE*>(src); break;
+    case asTYPEID_UINT16: i = *reinterpret_cast<const asWORD*>(src); break;
+    case asTYPEID_UINT32: i = *reinterpret_cast<const asUINT*>(src); break;
+    case asTYPEID_UINT64: i = asINT64(*reinterpret_cast<const asQWORD*>(src)); break;
+    case asTYPEID_FLOAT: d = *reinterpret_cast<const float*>(src); isFloat = true; break;
+    case asTYPEID_DOUBLE: d = *reinterpret_cast<const double*>(src); isFloat = true; break;
+    default:
+        // enums are stored as 32 bits integers
+        i = *reinterpret_cast<const int*>(src);
+        break;
+    }
+    if (isFloat)
+        i = asINT64(d);
+    else
+        d = double(i);
+
+    switch (dstTypeId)
+    {
+    case asTYPEID_BOOL: *reinterpret_cast<bool*>(dst) = isFloat ? (d != 0) : (i != 0); break;
+    case asTYPEID_INT8: *reinterpret_cast<signed char*>(dst) = (signed char)i; break;
+    case asTYPEID_INT16: *reinterpret_cast<short*>(dst) = (short)i; break;
+    case asTYPEID_INT32: *reinterpret_cast<int*>(dst) = (int)i; break;
+    case asTYPEID_INT64: *reinterpret_cast<asINT64*>(dst) = i; break;
+    case asTYPEID_UINT8: *reinterpret_cast<asBYTE*>(dst) = (asBYTE)i; break;
+    case asTYPEID_UINT16: *reinterpret_cast<asWORD*>(dst) = (asWORD)i; break;
+    case asTYPEID_UINT32: *reinterpret_cast<asUINT*>(dst) = (asUINT)i; break;
+    case asTYPEID_UINT64: *reinterpret_cast<asQWORD*>(dst) = (asQWORD)i; break;
+    case asTYPEID_FLOAT: *reinterpret_cast<float*>(dst) = float(d); break;
+    case asTYPEID_DOUBLE: *reinterpret_cast<double*>(dst) = d; break;
+    default:
+        // enums: only accept the same enum type
+        if (srcTypeId != dstTypeId)
+            return false;
+        *reinterpret_cast<int*>(dst) = (int)i;
+        break;
+    }
+    return true;
+}
+
+// maximum number of arguments forwarded to generator functions
+static const asUINT kMaxGeneratorArgs = 4;
+
+// Sets an argument of a prepared generator context (converted to the parameter type).
+// Reference parameters are not supported, as the generator outlives the caller.
+static bool SetGeneratorArg(asIScriptContext *coctx, asUINT index, void *ref, int refTypeId)
+{
+    asIScriptFunction* func = coctx->GetFunction();
+    int paramTypeId = 0;
+    asDWORD flags = 0;
+    if (func == NULL || ref == NULL || func->GetParam(index, &paramTypeId, &flags) < 0)
+        return false;
+    if ((flags & asTM_INOUTREF) != 0 || paramTypeId == asTYPEID_VOID)
+        return false;
+
+    // primitives are converted in place
+    if (IsPrimitiveTypeId(paramTypeId))
+    {
+        if (!IsPrimitiveTypeId(refTypeId))
+            return false;
+        return ConvertPrimitiveValue(ref, refTypeId, coctx->GetAddressOfArg(index), paramTypeId);
+    }
+    if (!(refTypeId & asTYPEID_MASK_OBJECT))
+        return false;
+    void* obj = (refTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<void**>(ref) : ref;
+
+    // handles: cast to the parameter type
+    if (paramTypeId & asTYPEID_OBJHANDLE)
+    {
+        if (obj == NULL)
+            return coctx->SetArgObject(index, NULL) >= 0;
+        asIScriptEngine* engine = coctx->GetEngine();
+        asITypeInfo* paramType = engine->GetTypeInfoById(paramTypeId);
+        void* castObj = NULL;
+        engine->RefCastObject(obj, engine->GetTypeInfoById(refTypeId), paramType, &castObj);
+        if (castObj == NULL)
+            return false;
+        int r = coctx->SetArgObject(index, castObj);
+        engine->ReleaseScriptObject(castObj, paramType);
+        return r >= 0;
+    }
+
+    // objects by value: copied by the context
+    int mask = ~(asTYPEID_OBJHANDLE | asTYPEID_HANDLETOCONST);
+    if (obj == NULL || (refTypeId & mask) != (paramTypeId & mask))
+        return false;
+    return coctx->SetArgObject(index, obj) >= 0;
+}
+
+// Sets all the arguments of a prepared generator context (their number must match)
+static bool SetGeneratorArgs(asIScriptContext *coctx, asUINT numArgs, void **refs, const int *refTypeIds)
+{
+    bool ok = coctx->GetFunction() != NULL && coctx->GetFunction()->GetParamCount() == numArgs;
+    for (asUINT i = 0; ok && i < numArgs; i++)
+    {
+        ok = SetGeneratorArg(coctx, i, refs[i], refTypeIds[i]);
+    }
+    return ok;
+}
+
+// Creates a context for a generator function with any signature, and forwards the
+// arguments with SetArg* (no container allocated). Returns 0 if the arguments do not
+// match the parameters of the function.
+asIScriptContext * CreateContextForGenerator(asIScriptContext *currCtx, asIScriptFunction *func, asUINT numArgs, void **refs, const int *refTypeIds)
+{
+    asIScriptContext *coctx = CreateContextForGenerator(currCtx, func);
+    if (coctx == 0)
+        return 0;
+
+    if (!SetGeneratorArgs(coctx, numArgs, refs, refTypeIds))
+    {
+        ReturnContextForGenerator(coctx);
+        return 0;
+    }
+    return coctx;
+}
+
+// createGenerator(?&in func, ?&in...) and typedGenerator<T>(?&in func, ?&in...):
+// func is a handle to any funcdef (function or delegate), followed by its arguments.
+// Always registered with the generic calling convention (variable arguments).
+static void CreateGeneratorWithArgs(asIScriptGeneric *gen, asITypeInfo *valueType, asUINT firstArg)
+{
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx == NULL)
+        return;
+
+    // the function handle
+    asIScriptEngine* engine = gen->GetEngine();
+    int funcTypeId = gen->GetArgTypeId(firstArg);
+    asITypeInfo* funcType = engine->GetTypeInfoById(funcTypeId);
+    void* funcRef = gen->GetArgAddress(firstArg);
+    asIScriptFunction* func = NULL;
+    if (funcType != NULL && (funcType->GetFlags() & asOBJ_FUNCDEF) && funcRef != NULL)
+        func = (funcTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<asIScriptFunction**>(funcRef) : reinterpret_cast<asIScriptFunction*>(funcRef);
+    if (func == NULL)
+    {
+        ctx->SetException("Generator function expected");
+        return;
+    }
+
+    // the arguments
+    void* refs[kMaxGeneratorArgs];
+    int refTypeIds[kMaxGeneratorArgs];
+    asUINT numArgs = asUINT(gen->GetArgCount()) - firstArg - 1;
+    for (asUINT i = 0; i < numArgs; i++)
+    {
+        refs[i] = gen->GetArgAddress(firstArg + 1 + i);
+        refTypeIds[i] = gen->GetArgTypeId(firstArg + 1 + i);
+    }
+
+    // real-time threads: create the generator in the arena (null handle if full)
+    CGeneratorArena* arena = threadGeneratorArena;
+    if (arena != NULL && arena->GetEngine() == engine)
+    {
+        bool full = arena->GetNumAvailable() == 0;
+        CGenerator* generator = arena->Create(func, numArgs, refs, refTypeIds, valueType);
+        if (generator == NULL && !full)
+            ctx->SetException("Generator cannot be created with these arguments in the arena");
+        gen->SetReturnAddress(generator);
+        return;
+    }
+
+    asIScriptContext *coctx = CreateContextForGenerator(ctx, func, numArgs, refs, refTypeIds);
+    if (coctx == NULL)
+    {
+        ctx->SetException("Generator arguments do not match the function parameters");
+        return;
+    }
+    CGenerator* generator = new CGenerator(coctx, valueType);
+    gen->SetReturnAddress(generator);
+}
+
+void ScriptCreateGeneratorWithArgs_generic(asIScriptGeneric *gen)
+{
+    CreateGeneratorWithArgs(gen, NULL, 0);
+}
+
+void ScriptCreateTypedGeneratorWithArgs_generic(asIScriptGeneric *gen)
+{
+    asITypeInfo* type = *reinterpret_cast<asITypeInfo**>(gen->GetAddressOfArg(0));
+    CreateGeneratorWithArgs(gen, type, 1);
+}
+
+// registers the variable arguments overloads of createGenerator and typedGenerator<T>
+static void RegisterGeneratorArgsOverloads(asIScriptEngine *engine)
+{
+    int r = 0;
+    std::string args;
+    for (asUINT i = 0; i <= kMaxGeneratorArgs; i++)
+    {
+        r = engine->RegisterGlobalFunction(("generator@ createGenerator(?&in func" + args + ")").c_str(), asFUNCTION(ScriptCreateGeneratorWithArgs_generic), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("typedGenerator<T>", asBEHAVE_FACTORY, ("typedGenerator<T>@ f(int&in, ?&in func" + args + ")").c_str(), asFUNCTION(ScriptCreateTypedGeneratorWithArgs_generic), asCALL_GENERIC); assert(r >= 0);
+        args += ", ?&in";
+    }
+}
+
+#ifdef AS_MAX_PORTABILITY
+void ScriptYield_generic(asIScriptGeneric *)
+{
+    ScriptYield();
+}
+
+void ScriptCreateGenerator_generic(asIScriptGeneric *gen)
+{
+    asIScriptFunction *func = reinterpret_cast<asIScriptFunction*>(gen->GetArgAddress(0));
+    CScriptDictionary *dict = reinterpret_cast<CScriptDictionary*>(gen->GetArgAddress(1));
+    ScriptCreateGenerator(func, dict);
+}
+#endif
+
+CGenerator::CGenerator(asIScriptContext *context, asITypeInfo *iValueType, CGeneratorArena* iArena) :
+    ctx(context),
+    refCount(1),
+    engine(context ? context->GetEngine() : NULL),
+    delegate(NULL),
+    delegator(NULL),
+    activeDelegate(NULL),
+    gcPolicy(NULL),
+    combinator(NULL),
+    aborted(false),
+    hasAbortTime(false),
+    cancellationToken(NULL),
+    hasException(false),
+    exceptionFunction(NULL),
+    exceptionLine(0),
+    arena(iArena),
+    contextPool(NULL),
+    quotaLines(0),
+    quotaTime(0),
+    preempted(false),
+    quotaLineCount(0),
+    quotaRoot(NULL),
+    memoryLimit(0),
+    callstackLimit(0),
+    waitMode(kWaitNone),
+    waitDuration(0),
+    waitSamplePosition(0),
+    waitEvent(NULL),
+    waitFuture(NULL),
+    wakeTime(0),
+    linkPrev(NULL),
+    linkNext(NULL),
+    linkList(NULL),
+    yieldReturn(NULL),
+    value(NULL),
+    valueType(iValueType),
+    valueTypeId(asTYPEID_VOID)
+{
+    yieldReturnBuffers[0] = yieldReturnBuffers[1] = NULL;
+    yieldReturnBaseRefCounts[0] = yieldReturnBaseRefCounts[1] = 0;
+    typedValue.i = 0;
+    memset(&m_memoryStats, 0, sizeof(m_memoryStats));
+
+    // typed generator: keep the template instance type and prepare storage
+    if (valueType)
+    {
+        valueType->AddRef();
+        valueTypeId = valueType->GetSubTypeId();
+
+        // non-handle object types are stored as a copy that is reused for all values
+        if ((valueTypeId & asTYPEID_MASK_OBJECT) && !(valueTypeId & asTYPEID_OBJHANDLE))
+            typedValue.obj = valueType->GetEngine()->CreateScriptObject(valueType->GetSubType());
+    }
+
+    // store the context and create our ScriptAny value (provided by the arena if any)
+    if (ctx)
+    {
+        // the context goes back to the pool it was requested from, even if the 
+        // generator completes on another thread (the arena sets its own pool)
+        if (arena == NULL)
+            contextPool = GetContextPoolForThread(engine);
+        ctx->SetUserData(this, YIELD_GENERATOR);
+        if (valueType == NULL && arena == NULL)
+            value=new CScriptAny(ctx->GetEngine());
+    }
+    m_numExecutions = 0;
+    m_numGCObjectsCreated = 0;
+    m_numGCObjectsDestroyed = 0;
+    m_numYields = 0;
+    m_totalTime = 0;
+    m_maxTime = 0;
+    m_gcTime = 0;
+    m_creationTime = std::chrono::steady_clock::now();
+    m_statsEnabled = false;
+    m_engineStats = (ctx && arena == NULL) ? GetEngineStats(ctx->GetEngine()) : NULL;
+}
+
+CGenerator::CGenerator(asIScriptEngine *iEngine, CGeneratorCombinator* iCombinator) :
+    CGenerator(static_cast<asIScriptContext*>(NULL))
+{
+    engine = iEngine;
+    combinator = iCombinator;
+    value = new CScriptAny(engine);
+    m_engineStats = GetEngineStats(engine);
+}
+
+CGenerator::~CGenerator()
+{
+    {
+        // read the binding under the lock: the token may be cancelling on another thread
+        std::lock_guard<std::recursive_mutex> lock(CGeneratorCancellationToken::GetBindingsMutex());
+        if (cancellationToken)
+            cancellationToken->Remove(this);
+    }
+    if (exceptionFunction)
+    {
+        exceptionFunction->Release();
+        exceptionFunction = NULL;
+    }
+
+    // release the sources of the combinator
+    if (combinator)
+    {
+        delete combinator;
+        combinator = NULL;
+    }
+
+    // release delegates chain
+    if (delegate)
+    {
+        delegate->delegator = NULL;
+        delegate->Release();
+        delegate = NULL;
+    }
+    activeDelegate = NULL;
+    if (waitEvent)
+    {
+        waitEvent->Release();
+        waitEvent = NULL;
+    }
+    if (waitFuture)
+    {
+        waitFuture->Release();
+        waitFuture = NULL;
+    }
+
+    // cleanup context
+    if (ctx)
+    {
+        // Return the context to the generator context pool
+        ClearValue();
+        ReleaseContext();
+    }
+
+    // cleanup value
+    if (value)
+    {
+        value->Release();
+        value=NULL;
+    }
+    if (valueType)
+    {
+        ClearValue();
+        if ((valueTypeId & asTYPEID_MASK_OBJECT) && !(valueTypeId & asTYPEID_OBJHANDLE) && typedValue.obj)
+            valueType->GetEngine()->ReleaseScriptObject(typedValue.obj, valueType->GetSubType());
+        typedValue.obj = NULL;
+        valueType->Release();
+        valueType = NULL;
+    }
+    // cleanup yieldReturn cache if any
+    yieldReturn=NULL;
+    for (int i = 0; i < 2; i++)
+    {
+        if (yieldReturnBuffers[i])
+        {
+            yieldReturnBuffers[i]->Release();
+            yieldReturnBuffers[i]=NULL;
+        }
+    }
+}
+
+int CGenerator::AddRef() const
+{
+    // Increase counter
+    return asAtomicInc(refCount);
+}
+
+int CGenerator::Release() const
+{
+    // Decrease the ref counter
+    if (asAtomicDec(refCount) == 0)
+    {
+        // Delete this object as no more references to it exists
+        if (arena)
+            arena->Free(const_cast<CGenerator*>(this));
+        else
+            delete this;
+        return 0;
+    }
+    return refCount;
+}
+
+bool CGenerator::DoNext()
+{
+    // a new wait may be requested during this step
+    waitMode = kWaitNone;
+    if (waitEvent)
+    {
+        waitEvent->Release();
+        waitEvent = NULL;
+    }
+    if (waitFuture)
+    {
+        waitFuture->Release();
+        waitFuture = NULL;
+    }
+
+    preempted = false;
+
+    // timeout
+    AbortIfExpired();
+
+    // resume the innermost active delegate directly
+    CGenerator* current = activeDelegate ? activeDelegate : this;
+    for (;;)
+    {
+        bool running = current->ExecuteStep(this);
+        if (running)
+        {
+            // suspended by the quota: no value until the next yield
+            if (preempted)
+            {
+                current->ClearValue();
+                return true;
+            }
+            // yieldFrom was called: start running the new delegate
+            if (current->delegate != NULL)
+            {
+                current = current->delegate;
+                activeDelegate = current;
+                continue;
+            }
+            // the value was yielded
+            return true;
+        }
+        if (current == this)
+            return false;
+
+        // the delegate is done: resume the generator that delegated to it
+        CGenerator* parent = current->delegator;
+        current->delegator = NULL;
+        parent->delegate = NULL;
+        current->Release();
+        current = parent;
+        activeDelegate = (current == this) ? NULL : current;
+    }
+}
+
+bool CGenerator::ExecuteStep(CGenerator* root)
+{
+    // combinators compute their values natively from their sources
+    if (combinator)
+    {
+        CGeneratorCombinator::Step step = combinator->Next(value, root);
+        SGeneratorEngineStats* engineStats = EnabledEngineStats(m_engineStats);
+        m_numExecutions++;
+        if (engineStats)
+            engineStats->numExecutions++;
+        if (step == CGeneratorCombinator::kStepValue)
+        {
+            m_numYields++;
+            if (engineStats)
+                engineStats->numYields++;
+            return true;
+        }
+
+        // no value when suspended by the sources
+        ClearValue();
+        if (step == CGeneratorCombinator::kStepSuspended)
+            return true;
+        delete combinator;
+        combinator = NULL;
+        return false;
+    }
+
+    if (ctx)
+    {
+        asIScriptEngine* engine = ctx->GetEngine();
+        if (engine)
+        {
+            CGeneratorGCPolicy* policy = GetGCPolicy();
+            if (policy == NULL)
+                policy = threadGCPolicy ? threadGCPolicy : GetGeneratorGCPolicy(engine);
+
+            // Gather some statistics from the GC, if required by the policy (or for memory accounting)
+            bool gcStatistics = policy->UsesGCStatistics() || memoryAccounting;
+            asUINT gcSize1 = 0, gcSize2 = 0;
+            if (gcStatistics)
+                engine->GetGCStatistics(&gcSize1);
+
+            // timing statistics are opt-in (reading the clock is not free)
+            SGeneratorEngineStats* engineStats = EnabledEngineStats(m_engineStats);
+            bool timing = m_statsEnabled || engineStats != NULL;
+
+            // Execute the script for this generator, until yield is called
+            // (or until the quota is exhausted).
+            typedef std::chrono::steady_clock Clock;
+            Clock::time_point startTime;
+            if (timing || root->quotaTime > 0)
+                startTime = Clock::now();
+            bool lineCallback = false;
+            if (root->quotaLines > 0 || root->quotaTime > 0 || memoryLimit > 0 || callstackLimit > 0)
+            {
+                root->quotaLineCount = 0;
+                root->quotaDeadline = startTime + std::chrono::microseconds((asINT64)root->quotaTime);
+                quotaRoot = root;
+                // line callbacks are not available with AS_MAX_PORTABILITY: quota and limits are ignored
+                lineCallback = ctx->SetLineCallback(asFUNCTION(ExecutionLineCallback), this, asCALL_CDECL) >= 0;
+            }
+
+            // attribute the memory allocated while running to this generator
+            SGeneratorMemoryStats* previousMemoryStats = threadMemoryStats;
+            threadMemoryStats = &m_memoryStats;
+            int r = ctx->Execute();
+            threadMemoryStats = previousMemoryStats;
+            if (lineCallback)
+                ctx->ClearLineCallback();
+            if (r == asEXECUTION_SUSPENDED && ctx->GetCallstackSize() > m_memoryStats.maxCallstackSize)
+                m_memoryStats.maxCallstackSize = ctx->GetCallstackSize();
+            Clock::time_point executeTime;
+            if (timing)
+                executeTime = Clock::now();
+
+            // Determine how many new objects were created in the GC
+            asUINT numNewObjects = 0;
+            if (gcStatistics)
+            {
+                engine->GetGCStatistics(&gcSize2);
+                if (gcSize2 > gcSize1)
+                    numNewObjects = gcSize2 - gcSize1;
+                m_numGCObjectsCreated += numNewObjects;
+            }
+            m_numExecutions++;
+
+            if (r != asEXECUTION_SUSPENDED)
+            {
+                // in case of exception, forward the exception to current context so that
+                // error is properly reported
+                if (r==asEXECUTION_EXCEPTION)
+                {
+                    // keep it for the host too (no active context on executor workers)
+                    StoreException(ctx);
+                    if (root != this)
+                        root->StoreException(ctx);
+                    asIScriptContext* currentCtx=asGetActiveContext();
+                    if (currentCtx != NULL)
+                    {
+                        currentCtx->SetException(ctx->GetExceptionString());
+                    }
+                }
+
+                // The context has terminated execution (for one reason or other)
+                // return the context to the pool now
+                ClearValue();
+                ReleaseContext();
+            }
+
+            // Let the policy collect garbage (or not)
+            asUINT numDestroyedObjects = policy->AfterExecute(engine, numNewObjects);
+            m_numGCObjectsDestroyed += numDestroyedObjects;
+
+            bool yielded = (r == asEXECUTION_SUSPENDED) && !root->preempted;
+            if (yielded)
+                m_numYields++;
+
+            // timing statistics
+            if (timing)
+            {
+                Clock::time_point endTime = Clock::now();
+                asINT64 time = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+                asINT64 gcTime = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - executeTime).count();
+                m_totalTime += time / 1000.0;
+                m_gcTime += gcTime / 1000.0;
+                if (time / 1000.0 > m_maxTime)
+                    m_maxTime = time / 1000.0;
+
+                if (engineStats)
+                {
+                    engineStats->numExecutions++;
+                    if (yielded)
+                        engineStats->numYields++;
+                    engineStats->numGCObjectsCreated += numNewObjects;
+                    engineStats->numGCObjectsDestroyed += numDestroyedObjects;
+                    engineStats->totalTime += time;
+                    engineStats->gcTime += gcTime;
+                    asINT64 maxTime = engineStats->maxTime;
+                    while (time > maxTime && !engineStats->maxTime.compare_exchange_weak(maxTime, time))
+                    {
+                    }
+                }
+            }
+        }
+    }
+
+    return ctx != NULL;
+}
+
+void CGenerator::ExecutionLineCallback(asIScriptContext* context, CGenerator* generator)
+{
+    // memory limits of the running generator
+    if (generator->memoryLimit > 0 || generator->callstackLimit > 0)
+    {
+        SGeneratorMemoryStats& stats = generator->m_memoryStats;
+        asUINT callstackSize = context->GetCallstackSize();
+        if (callstackSize > stats.maxCallstackSize)
+            stats.maxCallstackSize = callstackSize;
+        if (generator->callstackLimit > 0 && callstackSize > generator->callstackLimit)
+        {
+            context->SetException("Generator call stack limit exceeded");
+            return;
+        }
+        if (generator->memoryLimit > 0 && stats.bytesAllocated > stats.bytesFreed &&
+            stats.bytesAllocated - stats.bytesFreed > generator->memoryLimit)
+        {
+            context->SetException("Generator memory limit exceeded");
+            return;
+        }
+    }
+
+    // preemption quota of the outermost generator
+    CGenerator* root = generator->quotaRoot;
+    if (root->quotaLines == 0 && root->quotaTime <= 0)
+        return;
+    root->quotaLineCount++;
+    bool exhausted = root->quotaLines > 0 && root->quotaLineCount >= root->quotaLines;
+
+    // reading the clock is not free: only check the time every few lines
+    if (!exhausted && root->quotaTime > 0 && (root->quotaLineCount & 15) == 0)
+        exhausted = std::chrono::steady_clock::now() >= root->quotaDeadline;
+
+    if (exhausted)
+    {
+        root->preempted = true;
+        context->Suspend();
+    }
+}
+
+void CGenerator::SetQuota(asUINT maxLines, double maxMicroseconds)
+{
+    quotaLines = maxLines;
+    quotaTime = maxMicroseconds > 0 ? maxMicroseconds : 0;
+}
+
+asUINT CGenerator::GetLineQuota() const
+{
+    return quotaLines;
+}
+
+double CGenerator::GetTimeQuota() const
+{
+    return quotaTime;
+}
+
+bool CGenerator::WasPreempted() const
+{
+    return preempted;
+}
+
+SGeneratorMemoryStats CGenerator::GetMemoryStats() const
+{
+    SGeneratorMemoryStats stats = m_memoryStats;
+    stats.numGCObjectsCreated = m_numGCObjectsCreated;
+    return stats;
+}
+
+void CGenerator::SetMemoryLimits(asQWORD maxBytes, asUINT maxCallstackSize)
+{
+    memoryLimit = maxBytes;
+    callstackLimit = maxCallstackSize;
+}
+
+bool CGenerator::NextValue()
+{
+    while (Next())
+    {
+        if (!preempted)
+            return true;
+    }
+    return false;
+}
+
+bool CGenerator::IsDone() const
+{
+    return ctx == NULL && combinator == NULL;
+}
+
+void CGenerator::Abort()
+{
+    aborted = true;
+
+    // abort the delegates first
+    if (delegate)
+    {
+        delegate->Abort();
+        delegate->delegator = NULL;
+        delegate->Release();
+        delegate = NULL;
+    }
+    // this generator (done) is now the innermost one: the one it delegates to will resume
+    CGenerator* root = this;
+    while (root->delegator)
+        root = root->delegator;
+    root->activeDelegate = (root == this) ? NULL : this;
+
+    if (combinator)
+    {
+        delete combinator;
+        combinator = NULL;
+        ClearValue();
+    }
+    if (ctx)
+    {
+        // running: Execute() will return asEXECUTION_ABORTED and release the context
+        if (ctx->GetState() == asEXECUTION_ACTIVE)
+        {
+            ctx->Abort();
+            return;
+        }
+        ClearValue();
+        ReleaseContext();
+    }
+}
+
+void CGenerator::AbortAfter(double milliseconds)
+{
+    hasAbortTime = milliseconds > 0;
+    if (hasAbortTime)
+        abortTime = std::chrono::steady_clock::now() + std::chrono::microseconds((asINT64)(milliseconds * 1000));
+}
+
+bool CGenerator::AbortIfExpired()
+{
+    if (!hasAbortTime || std::chrono::steady_clock::now() < abortTime)
+        return false;
+    hasAbortTime = false;
+    Abort();
+    return true;
+}
+
+void CGenerator::ReleaseContext()
+{
+    if (ctx == NULL)
+        return;
+    if (arena)
+        arena->ReturnContext(ctx);
+    else
+        ReturnContextForGenerator(ctx, contextPool);
+    ctx = NULL;
+}
+
+bool CGenerator::IsAborted() const
+{
+    return aborted;
+}
+
+void CGenerator::StoreException(asIScriptContext* context)
+{
+    hasException = true;
+    exceptionString = context->GetExceptionString() ? context->GetExceptionString() : "";
+    if (exceptionFunction)
+        exceptionFunction->Release();
+    exceptionFunction = context->GetExceptionFunction();
+    if (exceptionFunction)
+        exceptionFunction->AddRef();
+    exceptionLine = context->GetExceptionLineNumber();
+}
+
+const char* CGenerator::GetExceptionString() const
+{
+    return hasException ? exceptionString.c_str() : NULL;
+}
+
+asIScriptFunction* CGenerator::GetExceptionFunction() const
+{
+    return exceptionFunction;
+}
+
+int CGenerator::GetExceptionLineNumber() const
+{
+    return exceptionLine;
+}
+
+CGeneratorCancellationToken::CGeneratorCancellationToken() :
+    refCount(1),
+    cancelled(false)
+{
+}
+
+CGeneratorCancellationToken::~CGeneratorCancellationToken()
+{
+    // scope-bound: abort the generators when the token goes away
+    Cancel();
+}
+
+int CGeneratorCancellationToken::AddRef() const
+{
+    return asAtomicInc(refCount);
+}
+
+int CGeneratorCancellationToken::Release() const
+{
+    if (asAtomicDec(refCount) == 0)
+    {
+        delete this;
+        return 0;
+    }
+    return refCount;
+}
+
+std::recursive_mutex& CGeneratorCancellationToken::GetBindingsMutex()
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+void CGeneratorCancellationToken::Add(CGenerator* generator)
+{
+    if (generator == NULL)
+        return;
+    std::lock_guard<std::recursive_mutex> lock(GetBindingsMutex());
+    if (generator->cancellationToken == this)
+        return;
+    if (generator->cancellationToken)
+        generator->cancellationToken->Remove(generator);
+    if (cancelled)
+    {
+        generator->Abort();
+        return;
+    }
+    generator->cancellationToken = this;
+    generators.push_back(generator);
+}
+
+void CGeneratorCancellationToken::Remove(CGenerator* generator)
+{
+    std::lock_guard<std::recursive_mutex> lock(GetBindingsMutex());
+    for (size_t i = 0; i < generators.size(); i++)
+    {
+        if (generators[i] == generator)
+        {
+            generator->cancellationToken = NULL;
+            generators.erase(generators.begin() + i);
+            return;
+        }
+    }
+}
+
+void CGeneratorCancellationToken::Cancel()
+{
+    std::lock_guard<std::recursive_mutex> lock(GetBindingsMutex());
+    cancelled = true;
+
+    // aborting a generator may release others bound to this token: one at a time, and
+    // the generator stays bound until it is aborted (a generator being destroyed on 
+    // another thread waits for the lock to unbind itself, so it is still alive)
+    while (!generators.empty())
+    {
+        CGenerator* generator = generators.back();
+        generator->Abort();
+        Remove(generator);
+    }
+}
+
+bool CGeneratorCancellationToken::IsCancelled() const
+{
+    std::lock_guard<std::recursive_mutex> lock(GetBindingsMutex());
+    return cancelled;
+}
+
+asUINT CGeneratorCancellationToken::GetCount() const
+{
+    std::lock_guard<std::recursive_mutex> lock(GetBindingsMutex());
+    return asUINT(generators.size());
+}
+
+CGeneratorCancellationToken* ScriptCreateCancellationToken()
+{
+    return new CGeneratorCancellationToken();
+}
+
+// returns the generator or typedGenerator<T> passed as ?&in (exception if none)
+static CGenerator* GetGeneratorArg(void *ref, int refTypeId)
+{
+    CGenerator* generator = NULL;
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx)
+    {
+        asITypeInfo* type = ctx->GetEngine()->GetTypeInfoById(refTypeId);
+        if (type != NULL && (strcmp(type->GetName(), "generator") == 0 || strcmp(type->GetName(), "typedGenerator") == 0))
+            generator = (refTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<CGenerator**>(ref) : reinterpret_cast<CGenerator*>(ref);
+        if (generator == NULL)
+            ctx->SetException("Generator expected");
+    }
+    return generator;
+}
+
+void ScriptCancellationTokenAdd(void *ref, int refTypeId, CGeneratorCancellationToken* token)
+{
+    CGenerator* generator = GetGeneratorArg(ref, refTypeId);
+    if (generator)
+        token->Add(generator);
+}
+
+void ScriptCancellationTokenRemove(void *ref, int refTypeId, CGeneratorCancellationToken* token)
+{
+    CGenerator* generator = GetGeneratorArg(ref, refTypeId);
+    if (generator)
+        token->Remove(generator);
+}
+
+// numeric value of the last step of a generator (false if none or not numeric)
+static bool GetGeneratorValueAsDouble(const CGenerator* generator, double& value)
+{
+    int typeId = generator->GetValueTypeId();
+    if (typeId == asTYPEID_VOID)
+    {
+        const CScriptAny* any = generator->GetValue();
+        return any != NULL && any->Retrieve(value);
+    }
+    return IsPrimitiveTypeId(typeId) && ConvertPrimitiveValue(generator->GetTypedValue(), typeId, &value, asTYPEID_DOUBLE);
+}
+
+CGeneratorBlockAdapter::CGeneratorBlockAdapter(CGenerator* iGenerator, double iSampleRate, Interpolation iInterpolation) :
+    refCount(1),
+    generator(iGenerator),
+    sampleRate(iSampleRate),
+    interpolation(iInterpolation),
+    position(0),
+    done(iGenerator == NULL),
+    generatorTime(0),
+    hasValue(false),
+    currentValue(0),
+    currentTime(0),
+    hasNextValue(false),
+    nextValue(0),
+    nextTime(0)
+{
+    if (generator)
+        generator->AddRef();
+}
+
+CGeneratorBlockAdapter::~CGeneratorBlockAdapter()
+{
+    if (generator)
+        generator->Release();
+}
+
+int CGeneratorBlockAdapter::AddRef() const
+{
+    return asAtomicInc(refCount);
+}
+
+int CGeneratorBlockAdapter::Release() const
+{
+    if (asAtomicDec(refCount) == 0)
+    {
+        delete this;
+        return 0;
+    }
+    return refCount;
+}
+
+bool CGeneratorBlockAdapter::PullNextValue(asUINT& maxResumes)
+{
+    while (!done && maxResumes > 0)
+    {
+        maxResumes--;
+        if (!generator->Next())
+        {
+            done = true;
+            break;
+        }
+        // preempted: the generator needs more time, try again with the next block
+        if (generator->WasPreempted())
+            break;
+
+        double value = 0;
+        switch (generator->GetWaitMode())
+        {
+        case CGenerator::kWaitNone:
+            // yield() without a value (or not numeric) does not change the signal
+            if (GetGeneratorValueAsDouble(generator, value))
+            {
+                nextValue = value;
+                nextTime = asINT64(generatorTime + .5);
+                hasNextValue = true;
+                return true;
+            }
+            break;
+        case CGenerator::kWaitDuration:
+            generatorTime += generator->GetWaitDuration() * sampleRate * .001;
+            break;
+        case CGenerator::kWaitUntilSample:
+            if (double(generator->GetWaitSamplePosition()) > generatorTime)
+                generatorTime = double(generator->GetWaitSamplePosition());
+            break;
+        default:
+            // events and futures are not handled here: acts like yield
+            break;
+        }
+    }
+    return false;
+}
+
+asUINT CGeneratorBlockAdapter::Fill(double* buffer, asUINT numSamples)
+{
+    if (buffer == NULL)
+        return 0;
+
+    // at most one value per sample, plus waits and values that are immediately replaced
+    asUINT maxResumes = 2 * numSamples + 64;
+    asUINT index = 0;
+    while (index < numSamples)
+    {
+        asINT64 samplePosition = position + index;
+        if (!hasNextValue)
+            PullNextValue(maxResumes);
+
+        // the next value is reached: it becomes the current value
+        if (hasNextValue && nextTime <= samplePosition)
+        {
+            currentValue = nextValue;
+            currentTime = nextTime;
+            hasValue = true;
+            hasNextValue = false;
+            continue;
+        }
+
+        // render the segment until the next value (or the end of the block)
+        asUINT end = numSamples;
+        if (hasNextValue && nextTime - position < asINT64(end))
+            end = asUINT(nextTime - position);
+        if (interpolation == kLinear && hasValue && hasNextValue)
+        {
+            double slope = (nextValue - currentValue) / double(nextTime - currentTime);
+            for (asUINT i = index; i < end; i++)
+                buffer[i] = currentValue + slope * double(position + i - currentTime);
+        }
+        else
+        {
+            for (asUINT i = index; i < end; i++)
+                buffer[i] = currentValue;
+        }
+        index = end;
+    }
+    position += numSamples;
+    return numSamples;
+}
+
+asUINT CGeneratorBlockAdapter::Fill(CScriptArray* values, asUINT numSamples)
+{
+    if (values == NULL || values->GetElementTypeId() != asTYPEID_DOUBLE)
+        return 0;
+    values->Resize(numSamples);
+    if (numSamples == 0)
+        return 0;
+    return Fill(reinterpret_cast<double*>(values->At(0)), numSamples);
+}
+
+void CGeneratorBlockAdapter::SetInterpolation(Interpolation iInterpolation)
+{
+    interpolation = iInterpolation;
+}
+
+CGeneratorBlockAdapter::Interpolation CGeneratorBlockAdapter::GetInterpolation() const
+{
+    return interpolation;
+}
+
+asINT64 CGeneratorBlockAdapter::GetPosition() const
+{
+    return position;
+}
+
+bool CGeneratorBlockAdapter::IsDone() const
+{
+    return done;
+}
+
+CGenerator* CGeneratorBlockAdapter::GetGenerator() const
+{
+    return generator;
+}
+
+CGeneratorBlockAdapter* ScriptCreateBlockAdapter(void *ref, int refTypeId, double sampleRate, bool linear)
+{
+    CGenerator* generator = GetGeneratorArg(ref, refTypeId);
+    if (generator == NULL)
+        return NULL;
+    return new CGeneratorBlockAdapter(generator, sampleRate, linear ? CGeneratorBlockAdapter::kLinear : CGeneratorBlockAdapter::kSampleAndHold);
+}
+
+bool ScriptBlockAdapterGetLinear(const CGeneratorBlockAdapter* adapter)
+{
+    return adapter->GetInterpolation() == CGeneratorBlockAdapter::kLinear;
+}
+
+void ScriptBlockAdapterSetLinear(bool linear, CGeneratorBlockAdapter* adapter)
+{
+    adapter->SetInterpolation(linear ? CGeneratorBlockAdapter::kLinear : CGeneratorBlockAdapter::kSampleAndHold);
+}
+
+CGeneratorIterator::CGeneratorIterator() :
+    generator(NULL)
+{
+}
+
+CGeneratorIterator::CGeneratorIterator(CGenerator* iGenerator) :
+    generator(iGenerator)
+{
+    if (generator && !generator->NextValue())
+        generator = NULL;
+}
+
+CGenerator& CGeneratorIterator::operator*() const
+{
+    return *generator;
+}
+
+CGenerator* CGeneratorIterator::operator->() const
+{
+    return generator;
+}
+
+CGeneratorIterator& CGeneratorIterator::operator++()
+{
+    if (generator && !generator->NextValue())
+        generator = NULL;
+    return *this;
+}
+
+CGeneratorIterator CGeneratorIterator::operator++(int)
+{
+    CGeneratorIterator previous(*this);
+    ++(*this);
+    return previous;
+}
+
+bool CGeneratorIterator::operator==(const CGeneratorIterator& other) const
+{
+    return generator == other.generator;
+}
+
+bool CGeneratorIterator::operator!=(const CGeneratorIterator& other) const
+{
+    return generator != other.generator;
+}
+
+CGeneratorIterator begin(CGenerator& generator)
+{
+    return CGeneratorIterator(&generator);
+}
+
+CGeneratorIterator end(CGenerator&)
+{
+    return CGeneratorIterator();
+}
+
+// foreach support: the iterator is the index of the value
+asUINT ScriptGeneratorForBegin(CGenerator* generator)
+{
+    generator->NextValue();
+    return 0;
+}
+
+bool ScriptGeneratorForEnd(asUINT, const CGenerator* generator)
+{
+    return generator->IsDone();
+}
+
+asUINT ScriptGeneratorForNext(asUINT index, CGenerator* generator)
+{
+    generator->NextValue();
+    return index + 1;
+}
+
+const CScriptAny* ScriptGeneratorForValue(asUINT, const CGenerator* generator)
+{
+    return generator->GetValue();
+}
+
+const void* ScriptTypedGeneratorForValue(asUINT, const CGenerator* generator)
+{
+    return ScriptGetTypedValue(generator);
+}
+
+bool CGenerator::Next()
+{
+    // returned value is empty
+    CGenerator* target = activeDelegate ? activeDelegate : this;
+    if (target->yieldReturn != NULL)
+        target->yieldReturn->Store(0,0);
+    return DoNext();
+}
+
+bool CGenerator::Next(void *ref, int refTypeId)
+{
+    // store returned value inot the returned any object (of the active delegate if any)
+    CGenerator* target = activeDelegate ? activeDelegate : this;
+    if (target->yieldReturn != NULL)
+        target->yieldReturn->Store(ref,refTypeId);
+    return DoNext();
+}
+
+void CGenerator::WaitFor(double milliseconds)
+{
+    // delegates wait for the outermost generator, which is the one scheduled
+    CGenerator* root = this;
+    while (root->delegator)
+        root = root->delegator;
+    root->waitMode = kWaitDuration;
+    root->waitDuration = milliseconds;
+}
+
+void CGenerator::WaitUntilSample(asINT64 samplePosition)
+{
+    CGenerator* root = this;
+    while (root->delegator)
+        root = root->delegator;
+    root->waitMode = kWaitUntilSample;
+    root->waitSamplePosition = samplePosition;
+}
+
+void CGenerator::WaitEvent(CGeneratorEvent* event)
+{
+    CGenerator* root = this;
+    while (root->delegator)
+        root = root->delegator;
+    if (event)
+        event->AddRef();
+    if (root->waitEvent)
+        root->waitEvent->Release();
+    root->waitMode = kWaitEvent;
+    root->waitEvent = event;
+}
+
+CGeneratorEvent* CGenerator::GetWaitEvent() const
+{
+    return waitEvent;
+}
+
+void CGenerator::WaitFuture(CGeneratorFuture* future)
+{
+    CGenerator* root = this;
+    while (root->delegator)
+        root = root->delegator;
+    if (future)
+        future->AddRef();
+    if (root->waitFuture)
+        root->waitFuture->Release();
+    root->waitMode = kWaitFuture;
+    root->waitFuture = future;
+}
+
+CGeneratorFuture* CGenerator::GetWaitFuture() const
+{
+    return waitFuture;
+}
+
+void CGenerator::LinkTo(CGenerator** list)
+{
+    linkList = list;
+    linkPrev = NULL;
+    linkNext = *list;
+    if (*list)
+        (*list)->linkPrev = this;
+    *list = this;
+}
+
+void CGenerator::Unlink()
+{
+    if (linkList == NULL)
+        return;
+    if (linkPrev)
+        linkPrev->linkNext = linkNext;
+    else
+        *linkList = linkNext;
+    if (linkNext)
+        linkNext->linkPrev = linkPrev;
+    linkPrev = NULL;
+    linkNext = NULL;
+    linkList = NULL;
+}
+
+CGenerator::WaitMode CGenerator::GetWaitMode() const
+{
+    return waitMode;
+}
+
+double CGenerator::GetWaitDuration() const
+{
+    return waitDuration;
+}
+
+asINT64 CGenerator::GetWaitSamplePosition() const
+{
+    return waitSamplePosition;
+}
+
+bool CGenerator::Delegate(CGenerator* generator)
+{
+    // the delegate must produce the same type of values, and not be used by another generator
+    if (generator == NULL || generator == this || delegate != NULL ||
+        generator->delegator != NULL || generator->valueTypeId != valueTypeId)
+        return false;
+
+    generator->AddRef();
+    generator->delegator = this;
+    delegate = generator;
+    return true;
+}
+
+const CGenerator* CGenerator::GetValueSource() const
+{
+    return activeDelegate ? activeDelegate : this;
+}
+
+bool CGenerator::Next(asINT64 &value)
+{
+    return	Next(&value, asTYPEID_INT64);
+}
+
+bool CGenerator::Next(double &value)
+{
+    return	Next(&value, asTYPEID_DOUBLE);
+}
+
+asUINT CGenerator::NextN(CScriptArray* values, asUINT maxCount)
+{
+    asUINT count = 0;
+    if (values == NULL)
+        return 0;
+
+    // grow the array geometrically with the values (no reallocation if the array is 
+    // reused, and no huge allocation up front for a large maxCount), trimmed at the end
+    int elementTypeId = values->GetElementTypeId();
+    values->Resize(0);
+    asUINT size = 0;
+
+    int mask = ~asTYPEID_HANDLETOCONST;
+    while (count < maxCount && Next())
+    {
+        // do not block the caller longer than the quota
+        if (preempted)
+            break;
+
+        // the array sets an exception if it could not grow
+        if (count == size)
+        {
+            size = size < 8 ? 16 : size * 2;
+            if (size > maxCount)
+                size = maxCount;
+            values->Resize(size);
+            if (values->GetSize() != size)
+                break;
+        }
+        void* element = values->At(count);
+        if (element == NULL)
+            break;
+
+        bool ok = false;
+        const CGenerator* source = GetValueSource();
+        if (valueType == NULL)
+        {
+            // untyped generator: unbox into the element
+            ok = source->value->Retrieve(element, elementTypeId);
+        }
+        else if ((elementTypeId & mask) == (valueTypeId & mask))
+        {
+            // same type: direct copy
+            const void* valuePtr = GetTypedValue();
+            ok = valuePtr != NULL;
+            if (ok)
+                values->SetValue(count, const_cast<void*>(valuePtr));
+        }
+        else if (IsPrimitiveTypeId(valueTypeId) && IsPrimitiveTypeId(elementTypeId))
+        {
+            ok = ConvertPrimitiveValue(&source->typedValue, valueTypeId, element, elementTypeId);
+        }
+
+        if (!ok)
+        {
+            asIScriptContext* currentCtx = asGetActiveContext();
+            if (currentCtx)
+                currentCtx->SetException("Generator value cannot be converted to the array element type");
+            break;
+        }
+        count++;
+    }
+    values->Resize(count);
+    return count;
+}
+
+bool CGenerator::StoreValue(void *ref, int refTypeId)
+{
+    // untyped generator: box the value
+    if (valueType == NULL)
+    {
+        if (value)
+            value->Store(ref, refTypeId);
+        return true;
+    }
+
+    // yield() without value: keep previous value
+    if (ref == NULL)
+        return true;
+
+    asIScriptEngine* engine = valueType->GetEngine();
+    if (IsPrimitiveTypeId(valueTypeId))
+    {
+        if (!IsPrimitiveTypeId(refTypeId))
+            return false;
+        return ConvertPrimitiveValue(ref, refTypeId, &typedValue, valueTypeId);
+    }
+    else if (valueTypeId & asTYPEID_OBJHANDLE)
+    {
+        if (!(refTypeId & asTYPEID_MASK_OBJECT))
+            return false;
+
+        // get the object (the reference is to the handle for handles)
+        void* obj = (refTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<void**>(ref) : ref;
+        void* newObj = NULL;
+        if (obj)
+        {
+            asITypeInfo* fromType = engine->GetTypeInfoById(refTypeId);
+            asITypeInfo* toType = valueType->GetSubType();
+            if (fromType == toType)
+            {
+                newObj = obj;
+                engine->AddRefScriptObject(newObj, toType);
+            }
+            else
+            {
+                // the returned pointer holds a reference if the cast succeeded
+                engine->RefCastObject(obj, fromType, toType, &newObj);
+                if (newObj == NULL)
+                    return false;
+            }
+        }
+        ClearValue();
+        typedValue.obj = newObj;
+        return true;
+    }
+    else
+    {
+        // object values are copied into our own instance
+        int mask = ~(asTYPEID_OBJHANDLE | asTYPEID_HANDLETOCONST);
+        if ((refTypeId & mask) != (valueTypeId & mask) || typedValue.obj == NULL)
+            return false;
+        if (refTypeId & asTYPEID_OBJHANDLE)
+        {
+            ref = *reinterpret_cast<void**>(ref);
+            if (ref == NULL)
+                return false;
+        }
+        return engine->AssignScriptObject(typedValue.obj, ref, valueType->GetSubType()) >= 0;
+    }
+}
+
+void CGenerator::ClearValue()
+{
+    if (value)
+    {
+        value->Store(0,0);
+    }
+    else if (valueType && (valueTypeId & asTYPEID_OBJHANDLE))
+    {
+        if (typedValue.obj)
+            valueType->GetEngine()->ReleaseScriptObject(typedValue.obj, valueType->GetSubType());
+        typedValue.obj = NULL;
+    }
+}
+
+const void* CGenerator::GetTypedValue() const
+{
+    if (activeDelegate)
+        return activeDelegate->GetTypedValue();
+    if (valueType == NULL)
+        return NULL;
+    // the object itself for object types, or the address of the inline value
+    if ((valueTypeId & asTYPEID_MASK_OBJECT) && !(valueTypeId & asTYPEID_OBJHANDLE))
+        return typedValue.obj;
+    return &typedValue;
+}
+
+int CGenerator::GetValueTypeId() const
+{
+    return valueTypeId;
+}
+
+const CScriptAny* CGenerator::GetValue()const
+{
+    return GetValueSource()->value;
+}
+
+CScriptAny* CGenerator::GetValue()
+{
+    return activeDelegate ? activeDelegate->value : value;
+}
+
+CScriptAny* CGenerator::NewYieldReturnPtr(asIScriptEngine* engine)
+{
+    // reuse a container that is not referenced by the script anymore 
+    // (its ref count is back to the value it had when created)
+    int index = -1;
+    for (int i = 0; i < 2 && index < 0; i++)
+    {
+        if (yieldReturnBuffers[i] == NULL ? arena == NULL : yieldReturnBuffers[i]->GetRefCount() == yieldReturnBaseRefCounts[i])
+            index = i;
+    }
+
+    // arena generators never allocate: no container for this yield
+    if (index < 0 && arena)
+    {
+        yieldReturn = NULL;
+        return NULL;
+    }
+
+    // both containers are still held by the script: replace the oldest one 
+    // (the script keeps its own reference to it)
+    if (index < 0)
+    {
+        index = (yieldReturn == yieldReturnBuffers[0]) ? 1 : 0;
+        yieldReturnBuffers[index]->Release();
+        yieldReturnBuffers[index] = NULL;
+    }
+
+    if (yieldReturnBuffers[index] == NULL)
+    {
+        yieldReturnBuffers[index] = new CScriptAny(engine);
+        yieldReturnBaseRefCounts[index] = yieldReturnBuffers[index]->GetRefCount();
+    }
+    else
+    {
+        // clear previous content
+        yieldReturnBuffers[index]->Store(0,0);
+    }
+
+    // add a reference for the script (handle returned by yield)
+    yieldReturn = yieldReturnBuffers[index];
+    yieldReturn->AddRef();
+    return yieldReturn;
+}
+
+void CGenerator::SetGCPolicy(CGeneratorGCPolicy* policy)
+{
+    gcPolicy = policy;
+}
+
+CGeneratorGCPolicy* CGenerator::GetGCPolicy() const
+{
+    return gcPolicy;
+}
+
+CGenerator* CGenerator::Combine(int kind, CGenerator* other, asIScriptFunction* func, asUINT count)
+{
+    // combinators work with untyped values only
+    if (engine == NULL || valueType != NULL || (other != NULL && other->valueType != NULL))
+        return NULL;
+    switch (kind)
+    {
+    case CGeneratorCombinator::kMap:
+    case CGeneratorCombinator::kFilter:
+        if (func == NULL)
+            return NULL;
+        break;
+    case CGeneratorCombinator::kZip:
+        if (func == NULL || other == NULL)
+            return NULL;
+        break;
+    case CGeneratorCombinator::kChain:
+        if (other == NULL)
+            return NULL;
+        break;
+    case CGeneratorCombinator::kWindow:
+        if (count == 0 || engine->GetTypeInfoByDecl("array<any@>") == NULL)
+            return NULL;
+        break;
+    default:
+        break;
+    }
+    CGeneratorCombinator* newCombinator = new CGeneratorCombinator(CGeneratorCombinator::Kind(kind), this, other, func, count);
+    return new CGenerator(engine, newCombinator);
+}
+
+CGenerator* CGenerator::Map(asIScriptFunction* func)
+{
+    return Combine(CGeneratorCombinator::kMap, NULL, func, 0);
+}
+
+CGenerator* CGenerator::Filter(asIScriptFunction* func)
+{
+    return Combine(CGeneratorCombinator::kFilter, NULL, func, 0);
+}
+
+CGenerator* CGenerator::Take(asUINT count)
+{
+    return Combine(CGeneratorCombinator::kTake, NULL, NULL, count);
+}
+
+CGenerator* CGenerator::Skip(asUINT count)
+{
+    return Combine(CGeneratorCombinator::kSkip, NULL, NULL, count);
+}
+
+CGenerator* CGenerator::Zip(CGenerator* other, asIScriptFunction* func)
+{
+    return Combine(CGeneratorCombinator::kZip, other, func, 0);
+}
+
+CGenerator* CGenerator::Chain(CGenerator* other)
+{
+    return Combine(CGeneratorCombinator::kChain, other, NULL, 0);
+}
+
+CGenerator* CGenerator::Window(asUINT count)
+{
+    return Combine(CGeneratorCombinator::kWindow, NULL, NULL, count);
+}
+
+asIScriptEngine* CGenerator::GetEngine() const
+{
+    return engine;
+}
+
+void CGenerator::ForwardWait(const CGenerator* from)
+{
+    switch (from->waitMode)
+    {
+    case kWaitDuration:
+        WaitFor(from->waitDuration);
+        break;
+    case kWaitUntilSample:
+        WaitUntilSample(from->waitSamplePosition);
+        break;
+    case kWaitEvent:
+        WaitEvent(from->waitEvent);
+        break;
+    case kWaitFuture:
+        WaitFuture(from->waitFuture);
+        break;
+    default:
+        break;
+    }
+}
+
+CGeneratorCombinator::CGeneratorCombinator(Kind iKind, CGenerator* iSource, CGenerator* iOther, asIScriptFunction* iCallback, asUINT iCount) :
+    kind(iKind),
+    source(iSource),
+    other(iOther),
+    callback(iCallback),
+    count(iCount),
+    position(0),
+    sourceReady(false),
+    windowArrayType(NULL)
+{
+    if (source)
+        source->AddRef();
+    if (other)
+        other->AddRef();
+    if (callback)
+        callback->AddRef();
+    if (kind == kWindow && source)
+    {
+        windowArrayType = source->GetEngine()->GetTypeInfoByDecl("array<any@>");
+        if (windowArrayType)
+            windowArrayType->AddRef();
+    }
+}
+
+CGeneratorCombinator::~CGeneratorCombinator()
+{
+    ReleaseSources();
+    if (callback)
+    {
+        callback->Release();
+        callback = NULL;
+    }
+    if (windowArrayType)
+    {
+        windowArrayType->Release();
+        windowArrayType = NULL;
+    }
+}
+
+void CGeneratorCombinator::ReleaseSources()
+{
+    if (source)
+    {
+        source->Release();
+        source = NULL;
+    }
+    if (other)
+    {
+        other->Release();
+        other = NULL;
+    }
+    for (size_t i = 0; i < windowValues.size(); i++)
+    {
+        windowValues[i]->Release();
+    }
+    windowValues.clear();
+}
+
+CGeneratorCombinator::Step CGeneratorCombinator::NextSource(CGenerator* generator, CGenerator* root)
+{
+    if (!generator->Next())
+        return kStepDone;
+
+    // the source did not produce a value: the combinator generator is suspended too
+    if (generator->WasPreempted())
+    {
+        root->preempted = true;
+        return kStepSuspended;
+    }
+    if (generator->GetWaitMode() != CGenerator::kWaitNone)
+    {
+        root->ForwardWait(generator);
+        return kStepSuspended;
+    }
+    return kStepValue;
+}
+
+bool CGeneratorCombinator::Call(CScriptAny* arg1, CScriptAny* arg2, CScriptAny* result, bool* returnValue)
+{
+    if (callback == NULL || arg1 == NULL)
+        return false;
+
+    // call nested in the active context when possible (no context switch)
+    asIScriptEngine* engine = callback->GetEngine();
+    asIScriptContext* ctx = asGetActiveContext();
+    bool nested = ctx != NULL && ctx->GetEngine() == engine && ctx->PushState() >= 0;
+    if (!nested)
+        ctx = engine->RequestContext();
+    if (ctx == NULL)
+        return false;
+
+    int r = 0;
+    if (callback->GetFuncType() == asFUNC_DELEGATE)
+    {
+        r = ctx->Prepare(callback->GetDelegateFunction());
+        if (r >= 0)
+            r = ctx->SetObject(callback->GetDelegateObject());
+    }
+    else
+        r = ctx->Prepare(callback);
+    asUINT index = 0;
+    if (r >= 0)
+        r = ctx->SetArgAddress(index++, arg1);
+    if (r >= 0 && arg2)
+        r = ctx->SetArgAddress(index++, arg2);
+    if (r >= 0 && result)
+        r = ctx->SetArgAddress(index++, result);
+    if (r >= 0)
+        r = ctx->Execute();
+
+    bool ok = (r == asEXECUTION_FINISHED);
+    if (ok && returnValue)
+        *returnValue = ctx->GetReturnByte() != 0;
+    std::string exception;
+    if (r == asEXECUTION_EXCEPTION)
+        exception = ctx->GetExceptionString();
+    else if (!ok)
+        exception = "Combinator callback did not complete";
+
+    if (nested)
+        ctx->PopState();
+    else
+        engine->ReturnContext(ctx);
+
+    // forward the error to the caller, so that it is properly reported
+    // (or to the engine message callback when resumed by the host)
+    if (!ok)
+    {
+        asIScriptContext* currentCtx = asGetActiveContext();
+        if (currentCtx)
+            currentCtx->SetException(exception.c_str());
+        else
+        {
+            asIScriptFunction* func = callback->GetFuncType() == asFUNC_DELEGATE ? callback->GetDelegateFunction() : callback;
+            const char* section = NULL;
+            int row = 0, col = 0;
+            func->GetDeclaredAt(&section, &row, &col);
+            std::string message = std::string("Exception in combinator callback '") + func->GetDeclaration() + "': " + exception;
+            engine->WriteMessage(section ? section : "", row, col, asMSGTYPE_ERROR, message.c_str());
+        }
+    }
+    return ok;
+}
+
+CGeneratorCombinator::Step CGeneratorCombinator::Next(CScriptAny* result, CGenerator* root)
+{
+    if (source == NULL)
+        return kStepDone;
+
+    Step step = kStepDone;
+    switch (kind)
+    {
+    case kMap:
+        step = NextSource(source, root);
+        if (step != kStepValue)
+            break;
+        // the callback must not see the previous result
+        result->Store(0, 0);
+        if (!Call(source->GetValue(), NULL, result, NULL))
+            step = kStepDone;
+        break;
+    case kFilter:
+        for (;;)
+        {
+            step = NextSource(source, root);
+            if (step != kStepValue)
+                break;
+            bool keep = false;
+            if (!Call(source->GetValue(), NULL, NULL, &keep))
+            {
+                step = kStepDone;
+                break;
+            }
+            if (keep)
+            {
+                result->CopyFrom(source->GetValue());
+                break;
+            }
+        }
+        break;
+    case kTake:
+        if (position >= count)
+            break;
+        step = NextSource(source, root);
+        if (step == kStepValue)
+        {
+            position++;
+            result->CopyFrom(source->GetValue());
+        }
+        break;
+    case kSkip:
+        for (;;)
+        {
+            step = NextSource(source, root);
+            if (step != kStepValue)
+                break;
+            if (position < count)
+            {
+                position++;
+                continue;
+            }
+            result->CopyFrom(source->GetValue());
+            break;
+        }
+        break;
+    case kZip:
+        // the value of the source is kept while the other is suspended
+        if (!sourceReady)
+        {
+            step = NextSource(source, root);
+            if (step != kStepValue)
+                break;
+            sourceReady = true;
+        }
+        step = NextSource(other, root);
+        if (step != kStepValue)
+            break;
+        sourceReady = false;
+        result->Store(0, 0);
+        if (!Call(source->GetValue(), other->GetValue(), result, NULL))
+            step = kStepDone;
+        break;
+    case kChain:
+        step = NextSource(source, root);
+        if (step == kStepDone && other != NULL)
+        {
+            // continue with the other generator
+            source->Release();
+            source = other;
+            other = NULL;
+            step = NextSource(source, root);
+        }
+        if (step == kStepValue)
+            result->CopyFrom(source->GetValue());
+        break;
+    case kWindow:
+        if (windowArrayType == NULL)
+            break;
+        for (;;)
+        {
+            step = NextSource(source, root);
+            if (step != kStepValue)
+                break;
+
+            // keep a copy of the value, as the source reuses its container (copies
+            // are shared by the arrays of successive windows)
+            CScriptAny* copy = new CScriptAny(source->GetEngine());
+            copy->CopyFrom(source->GetValue());
+            windowValues.push_back(copy);
+            if (windowValues.size() > count)
+            {
+                windowValues.front()->Release();
+                windowValues.pop_front();
+            }
+            if (windowValues.size() == count)
+            {
+                CScriptArray* values = CScriptArray::Create(windowArrayType, count);
+                for (asUINT i = 0; i < count; i++)
+                {
+                    values->SetValue(i, &windowValues[i]);
+                }
+                result->Store(&values, windowArrayType->GetTypeId() | asTYPEID_OBJHANDLE);
+                values->Release();
+                break;
+            }
+        }
+        break;
+    }
+
+    if (step == kStepDone)
+        ReleaseSources();
+    return step;
+}
+
+static CGenerator* CheckCombinator(CGenerator* generator)
+{
+    if (generator == NULL)
+    {
+        asIScriptContext *ctx = asGetActiveContext();
+        if (ctx)
+            ctx->SetException("Invalid generator combinator");
+    }
+    return generator;
+}
+
+CGenerator* ScriptGeneratorMap(asIScriptFunction* func, CGenerator* generator)
+{
+    return CheckCombinator(generator->Map(func));
+}
+
+CGenerator* ScriptGeneratorFilter(asIScriptFunction* func, CGenerator* generator)
+{
+    return CheckCombinator(generator->Filter(func));
+}
+
+CGenerator* ScriptGeneratorTake(asUINT count, CGenerator* generator)
+{
+    return CheckCombinator(generator->Take(count));
+}
+
+CGenerator* ScriptGeneratorSkip(asUINT count, CGenerator* generator)
+{
+    return CheckCombinator(generator->Skip(count));
+}
+
+CGenerator* ScriptGeneratorZip(CGenerator* other, asIScriptFunction* func, CGenerator* generator)
+{
+    return CheckCombinator(generator->Zip(other, func));
+}
+
+CGenerator* ScriptGeneratorChain(CGenerator* other, CGenerator* generator)
+{
+    return CheckCombinator(generator->Chain(other));
+}
+
+CGenerator* ScriptGeneratorWindow(asUINT count, CGenerator* generator)
+{
+    return CheckCombinator(generator->Window(count));
+}
+
+CGeneratorArena::CGeneratorArena(asIScriptEngine* iEngine, asUINT iCapacity, CGeneratorGCPolicy* iGCPolicy) :
+    engine(iEngine),
+    capacity(iCapacity),
+    generators(NULL),
+    gcPolicy(iGCPolicy),
+    engineStats(NULL),
+    numFailures(0)
+{
+    // resolve everything that requires the engine lock now
+    if (gcPolicy == NULL)
+        gcPolicy = GetGeneratorGCPolicy(engine);
+    engineStats = GetEngineStats(engine);
+
+    // storage for the generators, and their value containers
+    generators = reinterpret_cast<CGenerator*>(::operator new(sizeof(CGenerator) * capacity));
+    slots.resize(capacity);
+    freeSlots.reserve(capacity);
+    contexts.reserve(capacity);
+    for (asUINT i = 0; i < capacity; i++)
+    {
+        Slot& slot = slots[i];
+        slot.value = new CScriptAny(engine);
+        slot.valueBaseRefCount = slot.value->GetRefCount();
+        for (int j = 0; j < 2; j++)
+        {
+            slot.yieldReturnBuffers[j] = new CScriptAny(engine);
+            slot.yieldReturnBaseRefCounts[j] = slot.yieldReturnBuffers[j]->GetRefCount();
+        }
+        freeSlots.push_back(capacity - 1 - i);
+        asIScriptContext* ctx = engine->CreateContext();
+        if (ctx)
+            contexts.push_back(ctx);
+    }
+}
+
+CGeneratorArena::~CGeneratorArena()
+{
+    // all generators must have been released
+    assert(freeSlots.size() == capacity);
+    for (asUINT i = 0; i < capacity; i++)
+    {
+        if (slots[i].value)
+            slots[i].value->Release();
+        for (int j = 0; j < 2; j++)
+        {
+            if (slots[i].yieldReturnBuffers[j])
+                slots[i].yieldReturnBuffers[j]->Release();
+        }
+    }
+    for (size_t i = 0; i < contexts.size(); i++)
+    {
+        contexts[i]->Release();
+    }
+    contexts.clear();
+    ::operator delete(generators);
+    generators = NULL;
+}
+
+void CGeneratorArena::Warmup(asIScriptFunction* func)
+{
+    if (func == NULL)
+        return;
+    for (size_t i = 0; i < contexts.size(); i++)
+    {
+        if (PrepareContextForGenerator(contexts[i], func) >= 0)
+            contexts[i]->SetUserData(NULL, YIELD_IS_ALLOWED);
+        contexts[i]->Unprepare();
+    }
+}
+
+void CGeneratorArena::ReturnContext(asIScriptContext* context)
+{
+    // a suspended context must be aborted to be unprepared (unwinding its stack)
+    if (context->GetState() == asEXECUTION_SUSPENDED)
+        context->Abort();
+    context->SetUserData(NULL, YIELD_IS_ALLOWED);
+    context->SetUserData(NULL, YIELD_GENERATOR);
+    context->Unprepare();
+    // no allocation: the capacity was reserved for all the contexts of the arena
+    contexts.push_back(context);
+}
+
+CGenerator* CGeneratorArena::Create(asIScriptFunction* func, asUINT numArgs, void** refs, const int* refTypeIds, asITypeInfo* valueType)
+{
+    if (freeSlots.empty() || contexts.empty())
+    {
+        numFailures++;
+        return NULL;
+    }
+    if (func == NULL)
+        return NULL;
+
+    // object values of typed generators would be allocated by the engine
+    int valueTypeId = valueType ? valueType->GetSubTypeId() : asTYPEID_VOID;
+    if ((valueTypeId & asTYPEID_MASK_OBJECT) && !(valueTypeId & asTYPEID_OBJHANDLE))
+        return NULL;
+
+    // untyped generators need the value container (unless still held by a script)
+    asUINT index = freeSlots.back();
+    Slot& slot = slots[index];
+    if (valueType == NULL && slot.value == NULL)
+    {
+        numFailures++;
+        return NULL;
+    }
+
+    // prepare the context with the arguments
+    asIScriptContext* coctx = contexts.back();
+    contexts.pop_back();
+    if (PrepareContextForGenerator(coctx, func) < 0 || !SetGeneratorArgs(coctx, numArgs, refs, refTypeIds))
+    {
+        ReturnContext(coctx);
+        return NULL;
+    }
+    freeSlots.pop_back();
+
+    // construct the generator in place, with the reserved containers
+    CGenerator* generator = new (generators + index) CGenerator(coctx, valueType, this);
+    generator->gcPolicy = gcPolicy;
+    generator->m_engineStats = engineStats;
+    if (valueType == NULL)
+    {
+        generator->value = slot.value;
+        generator->value->AddRef();
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (slot.yieldReturnBuffers[i])
+        {
+            generator->yieldReturnBuffers[i] = slot.yieldReturnBuffers[i];
+            generator->yieldReturnBuffers[i]->AddRef();
+            generator->yieldReturnBaseRefCounts[i] = generator->yieldReturnBuffers[i]->GetRefCount();
+        }
+    }
+    return generator;
+}
+
+void CGeneratorArena::Free(CGenerator* generator)
+{
+    asUINT index = asUINT(generator - generators);
+    assert(index < capacity);
+    generator->~CGenerator();
+
+    // containers still referenced by a script cannot be reused: leave them to the script
+    // (the GC holds a reference too: compare with the ref count they had when created)
+    Slot& slot = slots[index];
+    if (slot.value && slot.value->GetRefCount() > slot.valueBaseRefCount)
+    {
+        slot.value->Release();
+        slot.value = NULL;
+    }
+    else if (slot.value)
+    {
+        slot.value->Store(0, 0);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (slot.yieldReturnBuffers[i] && slot.yieldReturnBuffers[i]->GetRefCount() > slot.yieldReturnBaseRefCounts[i])
+        {
+            slot.yieldReturnBuffers[i]->Release();
+            slot.yieldReturnBuffers[i] = NULL;
+        }
+    }
+    freeSlots.push_back(index);
+}
+
+asIScriptEngine* CGeneratorArena::GetEngine() const
+{
+    return engine;
+}
+
+asUINT CGeneratorArena::GetCapacity() const
+{
+    return capacity;
+}
+
+asUINT CGeneratorArena::GetNumAvailable() const
+{
+    return asUINT(freeSlots.size());
+}
+
+asUINT CGeneratorArena::GetNumFailures() const
+{
+    return numFailures;
+}
+
+CGeneratorTimerWheel::CGeneratorTimerWheel() :
+    time(0),
+    count(0)
+{
+    memset(slots, 0, sizeof(slots));
+}
+
+void CGeneratorTimerWheel::Link(CGenerator* generator, CGenerator** slot)
+{
+    generator->LinkTo(slot);
+    count++;
+}
+
+void CGeneratorTimerWheel::Unlink(CGenerator* generator)
+{
+    generator->Unlink();
+    count--;
+}
+
+void CGeneratorTimerWheel::Insert(CGenerator* generator, asINT64 wakeTime)
+{
+    generator->wakeTime = wakeTime;
+
+    // due now: in the current slot (used when cascading, before the slot is processed)
+    asINT64 delta = wakeTime - time;
+    if (delta < 0)
+        delta = 0;
+
+    // find the level that covers this delay (the last level is clamped, and the 
+    // generator is inserted again when its slot is reached)
+    int level = 0;
+    while (level < kNumLevels - 1 && delta >= (asINT64(1) << (kLevelBits * (level + 1))))
+        level++;
+    asINT64 maxDelta = (asINT64(1) << (kLevelBits * kNumLevels)) - 1;
+    asINT64 slotTime = time + (delta < maxDelta ? delta : maxDelta);
+    int slot = int((slotTime >> (kLevelBits * level)) & (kNumSlots - 1));
+    Link(generator, &slots[level][slot]);
+}
+
+bool CGeneratorTimerWheel::Remove(CGenerator* generator)
+{
+    // check that the generator is linked in one of our slots
+    CGenerator** first = &slots[0][0];
+    CGenerator** last = &slots[kNumLevels - 1][kNumSlots - 1];
+    if (generator->linkList < first || generator->linkList > last)
+        return false;
+    Unlink(generator);
+    return true;
+}
+
+void CGeneratorTimerWheel::Cascade(int level)
+{
+    // move the generators of the current slot of this level to lower levels
+    int slot = int((time >> (kLevelBits * level)) & (kNumSlots - 1));
+    CGenerator* generator = slots[level][slot];
+    while (generator)
+    {
+        CGenerator* next = generator->linkNext;
+        Unlink(generator);
+        Insert(generator, generator->wakeTime);
+        generator = next;
+    }
+}
+
+void CGeneratorTimerWheel::Advance(asINT64 targetTime, std::deque<CGenerator*>& dueGenerators)
+{
+    while (time < targetTime)
+    {
+        // nothing sleeping: jump directly
+        if (count == 0)
+        {
+            time = targetTime;
+            break;
+        }
+        time++;
+
+        // reached the boundary of higher levels: cascade, starting with the highest one
+        if ((time & (kNumSlots - 1)) == 0)
+        {
+            int topLevel = 1;
+            while (topLevel < kNumLevels - 1 && ((time >> (kLevelBits * topLevel)) & (kNumSlots - 1)) == 0)
+                topLevel++;
+            for (int level = topLevel; level > 0; level--)
+                Cascade(level);
+        }
+
+        // wake up the generators of the current slot
+        CGenerator*& slot = slots[0][time & (kNumSlots - 1)];
+        while (slot)
+        {
+            CGenerator* generator = slot;
+            Unlink(generator);
+            if (generator->wakeTime <= time)
+                dueGenerators.push_back(generator);
+            else
+                Insert(generator, generator->wakeTime);
+        }
+    }
+}
+
+void CGeneratorTimerWheel::RemoveAll(std::deque<CGenerator*>& generators)
+{
+    for (int level = 0; level < kNumLevels; level++)
+    {
+        for (int slot = 0; slot < kNumSlots; slot++)
+        {
+            while (slots[level][slot])
+            {
+                CGenerator* generator = slots[level][slot];
+                Unlink(generator);
+                generators.push_back(generator);
+            }
+        }
+    }
+}
+
+void CGeneratorTimerWheel::GetAbortable(std::vector<CGenerator*>& generators) const
+{
+    if (count == 0)
+        return;
+    for (int level = 0; level < kNumLevels; level++)
+    {
+        for (int slot = 0; slot < kNumSlots; slot++)
+        {
+            for (CGenerator* generator = slots[level][slot]; generator; generator = generator->linkNext)
+            {
+                if (generator->hasAbortTime)
+                    generators.push_back(generator);
+            }
+        }
+    }
+}
+
+asINT64 CGeneratorTimerWheel::GetTime() const
+{
+    return time;
+}
+
+asUINT CGeneratorTimerWheel::GetCount() const
+{
+    return count;
+}
+
+CGeneratorEvent::CGeneratorEvent() :
+    refCount(1),
+    signaled(false)
+{
+}
+
+CGeneratorEvent::~CGeneratorEvent()
+{
+    // waiters hold a reference to the event while waiting
+    assert(waiters.empty());
+}
+
+int CGeneratorEvent::AddRef() const
+{
+    return asAtomicInc(refCount);
+}
+
+int CGeneratorEvent::Release() const
+{
+    if (asAtomicDec(refCount) == 0)
+    {
+        delete this;
+        return 0;
+    }
+    return refCount;
+}
+
+void CGeneratorEvent::Signal()
+{
+    signaled = true;
+
+    // keep this event alive while waking up waiters (they hold references to it)
+    AddRef();
+    for (size_t i = 0; i < waiters.size(); i++)
+    {
+        waiters[i].scheduler->Wake(waiters[i].generator);
+    }
+    waiters.clear();
+    Release();
+}
+
+void CGeneratorEvent::Reset()
+{
+    signaled = false;
+}
+
+bool CGeneratorEvent::IsSignaled() const
+{
+    return signaled;
+}
+
+asUINT CGeneratorEvent::GetWaiterCount() const
+{
+    return asUINT(waiters.size());
+}
+
+void CGeneratorEvent::AddWaiter(CGenerator* generator, CGeneratorScheduler* scheduler)
+{
+    Waiter waiter = { generator, scheduler };
+    waiters.push_back(waiter);
+}
+
+void CGeneratorEvent::RemoveWaiter(CGenerator* generator)
+{
+    for (size_t i = 0; i < waiters.size(); i++)
+    {
+        if (waiters[i].generator == generator)
+        {
+            waiters.erase(waiters.begin() + i);
+            break;
+        }
+    }
+}
+
+CGeneratorEvent* ScriptCreateEvent()
+{
+    return new CGeneratorEvent();
+}
+
+void ScriptEventWait(CGeneratorEvent* event)
+{
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx && !event->IsSignaled())
+    {
+        CGenerator* theGenerator = GetGeneratorForWait(ctx);
+        if (theGenerator)
+        {
+            theGenerator->WaitEvent(event);
+            ctx->Suspend();
+        }
+    }
+}
+
+CGeneratorFuture::CGeneratorFuture(asITypeInfo* iType) :
+    refCount(1),
+    type(iType),
+    valueTypeId(asTYPEID_VOID),
+    ready(false)
+{
+    value.i = 0;
+    if (type)
+    {
+        type->AddRef();
+        valueTypeId = type->GetSubTypeId();
+    }
+}
+
+CGeneratorFuture::~CGeneratorFuture()
+{
+    // waiters hold a reference to the future while waiting
+    assert(waiters.empty());
+    if (type)
+    {
+        if ((valueTypeId & asTYPEID_MASK_OBJECT) && value.obj)
+            type->GetEngine()->ReleaseScriptObject(value.obj, type->GetSubType());
+        value.obj = NULL;
+        type->Release();
+        type = NULL;
+    }
+}
+
+int CGeneratorFuture::AddRef() const
+{
+    return asAtomicInc(refCount);
+}
+
+int CGeneratorFuture::Release() const
+{
+    if (asAtomicDec(refCount) == 0)
+    {
+        delete this;
+        return 0;
+    }
+    return refCount;
+}
+
+bool CGeneratorFuture::Complete(void* ref, int refTypeId)
+{
+    if (type == NULL || ready)
+        return false;
+
+    // convert the value before taking the lock (may allocate for object copies)
+    asIScriptEngine* engine = type->GetEngine();
+    asITypeInfo* subType = type->GetSubType();
+    void* newObj = NULL;
+    asINT64 newValue = 0;
+    if (IsPrimitiveTypeId(valueTypeId))
+    {
+        if (!IsPrimitiveTypeId(refTypeId) || !ConvertPrimitiveValue(ref, refTypeId, &newValue, valueTypeId))
+            return false;
+    }
+    else if (valueTypeId & asTYPEID_OBJHANDLE)
+    {
+        if (!(refTypeId & asTYPEID_MASK_OBJECT))
+            return false;
+        void* obj = (refTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<void**>(ref) : ref;
+        if (obj)
+        {
+            asITypeInfo* fromType = engine->GetTypeInfoById(refTypeId);
+            if (fromType == subType)
+            {
+                newObj = obj;
+                engine->AddRefScriptObject(newObj, subType);
+            }
+            else
+            {
+                engine->RefCastObject(obj, fromType, subType, &newObj);
+                if (newObj == NULL)
+                    return false;
+            }
+        }
+    }
+    else
+    {
+        int mask = ~(asTYPEID_OBJHANDLE | asTYPEID_HANDLETOCONST);
+        if ((refTypeId & mask) != (valueTypeId & mask))
+            return false;
+        void* obj = (refTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<void**>(ref) : ref;
+        if (obj == NULL)
+            return false;
+        newObj = engine->CreateScriptObjectCopy(obj, subType);
+        if (newObj == NULL)
+            return false;
+    }
+
+    // store the value and wake up the waiters. Waiters are posted while locked, so
+    // that a scheduler removing a waiter either finds it here or in its completed list
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ready)
+    {
+        if (newObj)
+            engine->ReleaseScriptObject(newObj, subType);
+        return false;
+    }
+    if (valueTypeId & asTYPEID_MASK_OBJECT)
+        value.obj = newObj;
+    else
+        value.i = newValue;
+    ready = true;
+    for (size_t i = 0; i < waiters.size(); i++)
+    {
+        waiters[i].scheduler->PostFutureCompleted(waiters[i].generator);
+    }
+    waiters.clear();
+    return true;
+}
+
+bool CGeneratorFuture::IsReady() const
+{
+    return ready;
+}
+
+const void* CGeneratorFuture::GetValue() const
+{
+    if (!ready)
+        return NULL;
+    if ((valueTypeId & asTYPEID_MASK_OBJECT) && !(valueTypeId & asTYPEID_OBJHANDLE))
+        return value.obj;
+    return &value;
+}
+
+int CGeneratorFuture::GetValueTypeId() const
+{
+    return valueTypeId;
+}
+
+bool CGeneratorFuture::AddWaiter(CGenerator* generator, CGeneratorScheduler* scheduler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ready)
+        return false;
+    Waiter waiter = { generator, scheduler };
+    waiters.push_back(waiter);
+    return true;
+}
+
+void CGeneratorFuture::RemoveWaiter(CGenerator* generator)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < waiters.size(); i++)
+    {
+        if (waiters[i].generator == generator)
+        {
+            waiters.erase(waiters.begin() + i);
+            break;
+        }
+    }
+}
+
+CGeneratorFuture* ScriptCreateFuture(asITypeInfo* type)
+{
+    return new CGeneratorFuture(type);
+}
+
+bool ScriptFutureComplete(void* ref, CGeneratorFuture* future)
+{
+    return future->Complete(ref, future->GetValueTypeId());
+}
+
+const void* ScriptFutureGetValue(const CGeneratorFuture* future)
+{
+    const void* valuePtr = future->GetValue();
+    if (valuePtr == NULL)
+    {
+        asIScriptContext *ctx = asGetActiveContext();
+        if (ctx)
+            ctx->SetException("Future is not ready");
+    }
+    return valuePtr;
+}
+
+void ScriptAwait(void *ref, int refTypeId)
+{
+    asIScriptContext *ctx = asGetActiveContext();
+    if (ctx)
+    {
+        // accept future<T> objects only
+        asITypeInfo* type = ctx->GetEngine()->GetTypeInfoById(refTypeId);
+        if (type == NULL || strcmp(type->GetName(), "future") != 0)
+        {
+            ctx->SetException("await expects a future");
+            return;
+        }
+        CGeneratorFuture* future = (refTypeId & asTYPEID_OBJHANDLE) ? *reinterpret_cast<CGeneratorFuture**>(ref) : reinterpret_cast<CGeneratorFuture*>(ref);
+        if (future == NULL)
+        {
+            ctx->SetException("Null future passed to await");
+            return;
+        }
+        if (!future->IsReady())
+        {
+            CGenerator* theGenerator = GetGeneratorForWait(ctx);
+            if (theGenerator)
+            {
+                theGenerator->WaitFuture(future);
+                ctx->Suspend();
+            }
+        }
+    }
+}
+
+CGeneratorScheduler::CGeneratorScheduler() :
+    refCount(1),
+    sampleRate(1000),
+    eventWaiters(NULL),
+    numEventWaiters(0),
+    futureWaiters(NULL),
+    numFutureWaiters(0)
+{
+    ResetStatistics();
+}
+
+CGeneratorScheduler::~CGeneratorScheduler()
+{
+    Clear();
+}
+
+int CGeneratorScheduler::AddRef() const
+{
+    return asAtomicInc(refCount);
+}
+
+int CGeneratorScheduler::Release() const
+{
+    if (asAtomicDec(refCount) == 0)
+    {
+        delete this;
+        return 0;
+    }
+    return refCount;
+}
+
+void CGeneratorScheduler::Add(CGenerator* generator)
+{
+    if (generator)
+    {
+        generator->AddRef();
+        readyQueue.push_back(generator);
+    }
+}
+
+void CGeneratorScheduler::Remove(CGenerator* generator)
+{
+    if (generator && generator->linkList == &eventWaiters)
+    {
+        generator->Unlink();
+        numEventWaiters--;
+        generator->GetWaitEvent()->RemoveWaiter(generator);
+        generator->Release();
+        return;
+    }
+    if (generator && generator->linkList == &futureWaiters)
+    {
+        generator->Unlink();
+        numFutureWaiters--;
+        generator->GetWaitFuture()->RemoveWaiter(generator);
+        {
+            // may have been posted already by the future
+            std::lock_guard<std::mutex> lock(completedFuturesMutex);
+            for (size_t i = 0; i < completedFutures.size(); i++)
+            {
+                if (completedFutures[i] == generator)
+                {
+                    completedFutures.erase(completedFutures.begin() + i);
+                    break;
+                }
+            }
+        }
+        generator->Release();
+        return;
+    }
+    if (generator && timerWheel.Remove(generator))
+    {
+        generator->Release();
+        return;
+    }
+    for (std::deque<CGenerator*>::iterator iter = readyQueue.begin(); iter != readyQueue.end(); ++iter)
+    {
+        if (*iter == generator)
+        {
+            readyQueue.erase(iter);
+            generator->Release();
+            break;
+        }
+    }
+}
+
+void CGeneratorScheduler::Clear()
+{
+    // release outside of the queue, as releasing may run script code
+    std::deque<CGenerator*> generators;
+    generators.swap(readyQueue);
+    timerWheel.RemoveAll(generators);
+    while (eventWaiters)
+    {
+        CGenerator* generator = eventWaiters;
+        generator->Unlink();
+        generator->GetWaitEvent()->RemoveWaiter(generator);
+        generators.push_back(generator);
+    }
+    numEventWaiters = 0;
+    while (futureWaiters)
+    {
+        CGenerator* generator = futureWaiters;
+        generator->Unlink();
+        generator->GetWaitFuture()->RemoveWaiter(generator);
+        generators.push_back(generator);
+    }
+    numFutureWaiters = 0;
+    {
+        std::lock_guard<std::mutex> lock(completedFuturesMutex);
+        completedFutures.clear();
+    }
+    for (size_t i = 0; i < generators.size(); i++)
+    {
+        generators[i]->Release();
+    }
+}
+
+asUINT CGeneratorScheduler::AbortExpired()
+{
+    asUINT count = 0;
+
+    // ready generators are done when aborted, and removed at their next resume
+    for (size_t i = 0; i < readyQueue.size(); i++)
+    {
+        if (readyQueue[i]->AbortIfExpired())
+            count++;
+    }
+
+    // sleeping generators (the vector is kept to not allocate every time)
+    abortableGenerators.clear();
+    for (CGenerator* generator = eventWaiters; generator; generator = generator->linkNext)
+    {
+        if (generator->hasAbortTime)
+            abortableGenerators.push_back(generator);
+    }
+    for (CGenerator* generator = futureWaiters; generator; generator = generator->linkNext)
+    {
+        if (generator->hasAbortTime)
+            abortableGenerators.push_back(generator);
+    }
+    timerWheel.GetAbortable(abortableGenerators);
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < abortableGenerators.size(); i++)
+    {
+        CGenerator* generator = abortableGenerators[i];
+        if (now < generator->abortTime)
+            continue;
+        generator->AddRef();
+        Remove(generator);
+        generator->AbortIfExpired();
+        generator->Release();
+        count++;
+    }
+    abortableGenerators.clear();
+    return count;
+}
+
+asUINT CGeneratorScheduler::Tick(asUINT maxMicroseconds, asUINT maxSteps)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0;
+    asUINT steps = 0;
+
+    // generators with completed futures are ready again
+    ProcessCompletedFutures();
+
+    // resume each generator at most once (in the queue order), until the budget runs out
+    size_t count = readyQueue.size();
+    while (count > 0 && !readyQueue.empty())
     {
-        return 0;
+        if ((maxSteps > 0 && steps >= maxSteps) || (maxMicroseconds > 0 && elapsed >= maxMicroseconds))
+            break;
+
+        CGenerator* generator = readyQueue.front();
+        readyQueue.pop_front();
+        count--;
+
+        bool running = generator->Next();
+        steps++;
+        if (running)
+            Reschedule(generator);
+        else
+            generator->Release();
+
+        elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
     }
 
-    // Prepare the context
-    int r = coctx->Prepare(func);
-    if (r < 0)
+    // statistics
+    numTicks++;
+    lastTickMicroseconds = elapsed;
+    lastOverrunMicroseconds = 0;
+    if (maxMicroseconds > 0 && elapsed > maxMicroseconds)
     {
-        // Couldn't prepare the context
-        engine->ReturnContext(coctx);
-        return 0;
+        numOverruns++;
+        lastOverrunMicroseconds = elapsed - maxMicroseconds;
+        if (lastOverrunMicroseconds > maxOverrunMicroseconds)
+            maxOverrunMicroseconds = lastOverrunMicroseconds;
     }
-    coctx->SetUserData((void*)&kYieldAllowedMagic, YIELD_IS_ALLOWED);
-    return coctx;
+    return steps;
 }
 
-void* ScriptYieldObject(void *ref, int refTypeId)
+void CGeneratorScheduler::Reschedule(CGenerator* generator)
 {
-    void* returnPointer=0;
-    // Get a pointer to the context that is currently being executed
-    asIScriptContext *ctx = asGetActiveContext();
-    if (ctx)
+    // sleeping generators go to the timer wheel, unless already due
+    asINT64 wakeTime = 0;
+    switch (generator->GetWaitMode())
     {
-        void* data = ctx->GetUserData(YIELD_IS_ALLOWED);
-        if (data != NULL && (*reinterpret_cast<int*>(data) == kYieldAllowedMagic))
+    case CGenerator::kWaitNone:
+        readyQueue.push_back(generator);
+        return;
+    case CGenerator::kWaitDuration:
+        wakeTime = timerWheel.GetTime() + asINT64(generator->GetWaitDuration() * sampleRate / 1000.0 + .5);
+        break;
+    case CGenerator::kWaitUntilSample:
+        wakeTime = generator->GetWaitSamplePosition();
+        break;
+    case CGenerator::kWaitFuture:
+    {
+        CGeneratorFuture* future = generator->GetWaitFuture();
+        generator->LinkTo(&futureWaiters);
+        numFutureWaiters++;
+        if (future == NULL || !future->AddWaiter(generator, this))
         {
-            // get the generator
-            CGenerator* theGenerator = reinterpret_cast<CGenerator*>(ctx->GetUserData(YIELD_GENERATOR));
-            if (theGenerator)
-            {
-                // store value
-                theGenerator->GetValue()->Store(ref,refTypeId);
-
-                // store return object - the trick is that the execution of the VM will be stopped AFTER we have returned
-                // so the return value has to be a valid object, always.
-                returnPointer = reinterpret_cast<void*>(theGenerator->NewYieldReturnPtr(ctx->GetEngine()));
-            }
-            // The current context must be suspended so that VM will return from
-            // the Next() method where the context manager will continue.
-            ctx->Suspend();
+            // already completed
+            generator->Unlink();
+            numFutureWaiters--;
+            readyQueue.push_back(generator);
+        }
+        return;
+    }
+    case CGenerator::kWaitEvent:
+    {
+        CGeneratorEvent* event = generator->GetWaitEvent();
+        if (event && !event->IsSignaled())
+        {
+            generator->LinkTo(&eventWaiters);
+            numEventWaiters++;
+            event->AddWaiter(generator, this);
         }
         else
         {
-            // throw error
-            ctx->SetException("Cannot call yield outside of a generator function");
+            readyQueue.push_back(generator);
         }
+        return;
     }
-    return returnPointer;
+    }
+    if (wakeTime > timerWheel.GetTime())
+        timerWheel.Insert(generator, wakeTime);
+    else
+        readyQueue.push_back(generator);
 }
 
-void* ScriptYield()
+asUINT CGeneratorScheduler::GetReadyCount() const
 {
-    return ScriptYieldObject(NULL,0);
+    return asUINT(readyQueue.size());
 }
 
-void* ScriptYieldInt(asINT64 &value)
+void CGeneratorScheduler::Wake(CGenerator* generator)
 {
-    return	ScriptYieldObject(&value, asTYPEID_INT64);
+    generator->Unlink();
+    numEventWaiters--;
+    readyQueue.push_back(generator);
 }
 
-void* ScriptYieldDouble(double &value)
+void CGeneratorScheduler::PostFutureCompleted(CGenerator* generator)
 {
-    return	ScriptYieldObject(&value, asTYPEID_DOUBLE);
+    std::lock_guard<std::mutex> lock(completedFuturesMutex);
+    completedFutures.push_back(generator);
 }
 
-CGenerator* ScriptCreateGenerator(asIScriptFunction *func, CScriptDictionary *arg)
+void CGeneratorScheduler::ProcessCompletedFutures()
 {
-    CGenerator* gen = 0;
-    if (func != 0)
     {
-        asIScriptContext *ctx = asGetActiveContext();
-        if (ctx)
+        std::lock_guard<std::mutex> lock(completedFuturesMutex);
+        completedFuturesSwap.swap(completedFutures);
+    }
+    for (size_t i = 0; i < completedFuturesSwap.size(); i++)
+    {
+        CGenerator* generator = completedFuturesSwap[i];
+        if (generator->linkList == &futureWaiters)
         {
-            // Create a new context for the generator
-            asIScriptContext *coctx = CreateContextForGenerator(ctx, func);
-
-            // Pass the argument to the context
-            coctx->SetArgObject(0, arg);
-
-            // The generator will call Execute() on this context when "Next" is called
-            gen = new CGenerator(coctx);
+            generator->Unlink();
+            numFutureWaiters--;
+            readyQueue.push_back(generator);
         }
     }
-    return gen;
+    completedFuturesSwap.clear();
 }
 
-#ifdef AS_MAX_PORTABILITY
-void ScriptYield_generic(asIScriptGeneric *)
+asUINT CGeneratorScheduler::GetSleepingCount() const
 {
-    ScriptYield();
+    return timerWheel.GetCount() + numEventWaiters + numFutureWaiters;
 }
 
-void ScriptCreateGenerator_generic(asIScriptGeneric *gen)
+void CGeneratorScheduler::SetSampleRate(double iSampleRate)
 {
-    asIScriptFunction *func = reinterpret_cast<asIScriptFunction*>(gen->GetArgAddress(0));
-    CScriptDictionary *dict = reinterpret_cast<CScriptDictionary*>(gen->GetArgAddress(1));
-    ScriptCreateGenerator(func, dict);
+    if (iSampleRate > 0)
+        sampleRate = iSampleRate;
 }
-#endif
 
-CGenerator::CGenerator(asIScriptContext *context) :
-    ctx(context),
-    refCount(1),
-    yieldReturn(NULL),
-    value(NULL)
+double CGeneratorScheduler::GetSampleRate() const
 {
-    // store the context and create our ScriptAny value
-    if (ctx)
+    return sampleRate;
+}
+
+void CGeneratorScheduler::Advance(asUINT numSamples)
+{
+    timerWheel.Advance(timerWheel.GetTime() + numSamples, readyQueue);
+}
+
+asINT64 CGeneratorScheduler::GetTime() const
+{
+    return timerWheel.GetTime();
+}
+
+asUINT CGeneratorScheduler::GetNumTicks() const
+{
+    return numTicks;
+}
+
+asUINT CGeneratorScheduler::GetNumOverruns() const
+{
+    return numOverruns;
+}
+
+double CGeneratorScheduler::GetLastTickMicroseconds() const
+{
+    return lastTickMicroseconds;
+}
+
+double CGeneratorScheduler::GetLastOverrunMicroseconds() const
+{
+    return lastOverrunMicroseconds;
+}
+
+double CGeneratorScheduler::GetMaxOverrunMicroseconds() const
+{
+    return maxOverrunMicroseconds;
+}
+
+void CGeneratorScheduler::ResetStatistics()
+{
+    numTicks = 0;
+    numOverruns = 0;
+    lastTickMicroseconds = 0;
+    lastOverrunMicroseconds = 0;
+    maxOverrunMicroseconds = 0;
+}
+
+CGeneratorExecutor::CGeneratorExecutor(asIScriptEngine* iEngine, asUINT numWorkers, asUINT contextPoolSize, asUINT iStepsPerSlice) :
+    engine(iEngine),
+    gcPolicy(CGeneratorGCPolicy::kGCDeferred),
+    stepsPerSlice(iStepsPerSlice > 0 ? iStepsPerSlice : 1),
+    nextWorker(0),
+    numQueued(0),
+    numPending(0),
+    numSteals(0),
+    stopping(false)
+{
+    // the engine will be used from several threads
+    asPrepareMultithread();
+    engine->AddRef();
+
+    if (numWorkers == 0)
+        numWorkers = std::thread::hardware_concurrency();
+    if (numWorkers == 0)
+        numWorkers = 1;
+
+    // create all workers before starting them, as they steal work from each other
+    for (asUINT i = 0; i < numWorkers; i++)
     {
-        ctx->SetUserData(this, YIELD_GENERATOR);
-        value=new CScriptAny(ctx->GetEngine());
+        Worker* worker = new Worker();
+        worker->contextPool = contextPoolSize > 0 ? new CGeneratorContextPool(engine, contextPoolSize) : NULL;
+        workers.push_back(worker);
+    }
+    for (asUINT i = 0; i < numWorkers; i++)
+    {
+        workers[i]->thread = std::thread(&CGeneratorExecutor::Run, this, i);
     }
-    m_numExecutions = 0;
-    m_numGCObjectsCreated = 0;
-    m_numGCObjectsDestroyed = 0;
 }
 
-CGenerator::~CGenerator()
+CGeneratorExecutor::~CGeneratorExecutor()
 {
-    // cleanup context
-    if (ctx)
     {
-        // Return the context to the engine (and possible context pool configured in it)
-        ctx->SetUserData(NULL, YIELD_IS_ALLOWED);
-        ctx->SetUserData(NULL,YIELD_GENERATOR);
-        value->Store(0,0);
-        ctx->GetEngine()->ReturnContext(ctx);
-        ctx=NULL;
+        std::lock_guard<std::mutex> lock(workMutex);
+        stopping = true;
+    }
+    workCondition.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i]->thread.join();
     }
 
-    // cleanup value
-    if (value)
+    // release remaining work
+    for (size_t i = 0; i < workers.size(); i++)
     {
-        value->Release();
-        value=NULL;
+        for (size_t j = 0; j < workers[i]->queue.size(); j++)
+        {
+            workers[i]->queue[j]->Release();
+        }
+        delete workers[i]->contextPool;
+        delete workers[i];
     }
-    // cleanup yieldReturn cache if any
-    if (yieldReturn)
+    workers.clear();
+    for (size_t i = 0; i < completed.size(); i++)
     {
-        yieldReturn->Release();
-        yieldReturn=NULL;
+        completed[i]->Release();
     }
+    completed.clear();
+
+    engine->Release();
+    asUnprepareMultithread();
 }
 
-int CGenerator::AddRef() const
+void CGeneratorExecutor::Submit(CGenerator* generator)
 {
-    // Increase counter
-    return asAtomicInc(refCount);
+    if (generator)
+    {
+        // the workers must not collect garbage concurrently
+        assert(generator->GetGCPolicy() == NULL ||
+            generator->GetGCPolicy()->GetMode() == CGeneratorGCPolicy::kGCNever ||
+            generator->GetGCPolicy()->GetMode() == CGeneratorGCPolicy::kGCDeferred);
+        generator->AddRef();
+        numPending++;
+        PushWork(nextWorker++ % asUINT(workers.size()), generator);
+    }
 }
 
-int CGenerator::Release() const
+CGenerator* CGeneratorExecutor::PopCompleted()
 {
-    // Decrease the ref counter
-    if (asAtomicDec(refCount) == 0)
+    std::lock_guard<std::mutex> lock(completedMutex);
+    CGenerator* generator = NULL;
+    if (!completed.empty())
     {
-        // Delete this object as no more references to it exists
-        delete this;
-        return 0;
+        generator = completed.front();
+        completed.pop_front();
     }
-    return refCount;
+    return generator;
 }
 
-bool CGenerator::DoNext()
+void CGeneratorExecutor::WaitAll()
 {
-    if (ctx)
+    std::unique_lock<std::mutex> lock(completedMutex);
+    while (numPending > 0)
     {
-        asIScriptEngine* engine = ctx->GetEngine();
-        if (engine)
-        {
-            // Gather some statistics from the GC
-            asUINT gcSize1, gcSize2, gcSize3;
-            engine->GetGCStatistics(&gcSize1);
-
-            // store pointer to previous return value container to cleanup, AFTER the call
-            CScriptAny* prevYieldReturn=yieldReturn;
-            yieldReturn=NULL;
-
-            // Execute the script for this generator, until yield is called.
-            int r = ctx->Execute();
-
-            // cleanup our previous yield return object if any
-            if (prevYieldReturn != NULL)
-            {
-                prevYieldReturn->Release();
-                prevYieldReturn=NULL;
-            }
-
-            // Determine how many new objects were created in the GC
-            engine->GetGCStatistics(&gcSize2);
-            m_numGCObjectsCreated += gcSize2 - gcSize1;
-            m_numExecutions++;
-
-            if (r != asEXECUTION_SUSPENDED)
-            {
-                // in case of exception, forward the exception to current context so that
-                // error is properly reported
-                if (r==asEXECUTION_EXCEPTION)
-                {
-                    asIScriptContext* currentCtx=asGetActiveContext();
-                    if (currentCtx != NULL)
-                    {
-                        currentCtx->SetException(ctx->GetExceptionString());
-                    }
-                }
-
-                // The context has terminated execution (for one reason or other)
-                // return the context to the pool now
-                ctx->SetUserData(NULL, YIELD_IS_ALLOWED);
-                ctx->SetUserData(NULL,YIELD_GENERATOR);
-                value->Store(0,0);
-                engine->ReturnContext(ctx);
-                ctx = NULL;
-            }
-
-            // Destroy all known garbage if any new objects were created
-            if (gcSize2 > gcSize1)
-            {
-                engine->GarbageCollect(asGC_FULL_CYCLE | asGC_DESTROY_GARBAGE);
-
-                // Determine how many objects were destroyed
-                engine->GetGCStatistics(&gcSize3);
-                m_numGCObjectsDestroyed += gcSize3 - gcSize2;
-            }
-            // Just run an incremental step for detecting cyclic references
-            engine->GarbageCollect(asGC_ONE_STEP | asGC_DETECT_GARBAGE);
-        }
+        completedCondition.wait(lock);
     }
+}
 
-    return ctx != NULL;
+asUINT CGeneratorExecutor::GetNumWorkers() const
+{
+    return asUINT(workers.size());
 }
 
-bool CGenerator::Next()
+asUINT CGeneratorExecutor::GetNumPending() const
 {
-    // returned value is empty
-    if (yieldReturn != NULL)
-        yieldReturn->Store(0,0);
-    return DoNext();
+    return numPending;
 }
 
-bool CGenerator::Next(void *ref, int refTypeId)
+asUINT CGeneratorExecutor::GetNumSteals() const
 {
-    // store returned value inot the returned any object
-    if (yieldReturn != NULL)
-        yieldReturn->Store(ref,refTypeId);
-    return DoNext();
+    return numSteals;
 }
 
-bool CGenerator::Next(asINT64 &value)
+CGeneratorGCPolicy* CGeneratorExecutor::GetGCPolicy()
 {
-    return	Next(&value, asTYPEID_INT64);
+    return &gcPolicy;
 }
 
-bool CGenerator::Next(double &value)
+void CGeneratorExecutor::PushWork(asUINT index, CGenerator* generator, bool requeued)
 {
-    return	Next(&value, asTYPEID_DOUBLE);
+    {
+        // the worker takes its own work from the back of its queue
+        Worker* worker = workers[index];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (requeued)
+            worker->queue.push_front(generator);
+        else
+            worker->queue.push_back(generator);
+        numQueued++;
+    }
+
+    // wake up a sleeping worker (under lock to not miss a worker about to sleep)
+    std::lock_guard<std::mutex> lock(workMutex);
+    workCondition.notify_one();
 }
 
-const CScriptAny* CGenerator::GetValue()const
+CGenerator* CGeneratorExecutor::PopWork(asUINT index)
+{
+    // own queue first (most recent work)
+    {
+        Worker* worker = workers[index];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->queue.empty())
+        {
+            CGenerator* generator = worker->queue.back();
+            worker->queue.pop_back();
+            numQueued--;
+            return generator;
+        }
+    }
+
+    // then steal the oldest work from the other workers
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        Worker* victim = workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->queue.empty())
+        {
+            CGenerator* generator = victim->queue.front();
+            victim->queue.pop_front();
+            numQueued--;
+            numSteals++;
+            return generator;
+        }
+    }
+    return NULL;
+}
+
+void CGeneratorExecutor::Run(asUINT index)
 {
-    return value;
+    // no garbage collection on the workers (generators without their own policy), and
+    // generators created on the worker use its own context pool (no contention)
+    threadGCPolicy = &gcPolicy;
+    threadContextPool = workers[index]->contextPool;
+
+    for (;;)
+    {
+        CGenerator* generator = PopWork(index);
+        if (generator == NULL)
+        {
+            std::unique_lock<std::mutex> lock(workMutex);
+            if (stopping)
+                break;
+            if (numQueued == 0)
+                workCondition.wait(lock);
+            continue;
+        }
+
+        // run a slice of the generator
+        bool running = true;
+        for (asUINT i = 0; i < stepsPerSlice && running && !stopping; i++)
+        {
+            running = generator->Next();
+        }
+
+        if (running)
+        {
+            PushWork(index, generator, true);
+        }
+        else
+        {
+            // hand the generator back to the owning thread
+            std::lock_guard<std::mutex> lock(completedMutex);
+            completed.push_back(generator);
+            numPending--;
+            completedCondition.notify_all();
+        }
+    }
+
+    // cleanup this thread's resources before exiting
+    threadGCPolicy = NULL;
+    threadContextPool = NULL;
+    asThreadCleanup();
 }
 
-CScriptAny* CGenerator::GetValue()
+SGeneratorStats CGenerator::GetStats() const
 {
-    return value;
+    SGeneratorStats stats;
+    stats.numExecutions = m_numExecutions;
+    stats.numYields = m_numYields;
+    stats.numGCObjectsCreated = m_numGCObjectsCreated;
+    stats.numGCObjectsDestroyed = m_numGCObjectsDestroyed;
+    stats.totalTime = m_totalTime;
+    stats.maxTime = m_maxTime;
+    stats.gcTime = m_gcTime;
+    stats.yieldsPerSecond = YieldsPerSecond(m_numYields, m_creationTime);
+    return stats;
 }
 
-CScriptAny* CGenerator::NewYieldReturnPtr(asIScriptEngine* engine)
+void CGenerator::EnableStats(bool enable)
 {
-    // create new value, and store it for later (will have to be cleaned after Next is called)
-    yieldReturn=new CScriptAny(engine);
-    yieldReturn->AddRef();
-    return yieldReturn;
+    m_statsEnabled = enable;
 }
 
 #include "../autowrapper/aswrappedcall.h"
 
-void RegisterGeneratorSupport(asIScriptEngine *engine)
+void RegisterGeneratorSupport(asIScriptEngine *engine, asUINT contextPoolSize)
 {
     int r;
 
@@ -302,8 +3878,38 @@ void RegisterGeneratorSupport(asIScriptEngine *engine)
     assert(engine->GetTypeInfoByDecl("dictionary"));
     assert(engine->GetTypeInfoByDecl("any"));
 
+    // create and pre-warm the context pool for generators (opt-in)
+    if (contextPoolSize > 0 && GetGeneratorContextPool(engine) == NULL)
+    {
+        engine->SetUserData(new CGeneratorContextPool(engine, contextPoolSize), GENERATOR_CONTEXT_POOL);
+        engine->SetEngineUserDataCleanupCallback(CleanupGeneratorContextPool, GENERATOR_CONTEXT_POOL);
+    }
+
+    // engine-wide statistics
+    if (GetEngineStats(engine) == NULL)
+    {
+        engine->SetUserData(new SGeneratorEngineStats(), GENERATOR_ENGINE_STATS);
+        engine->SetEngineUserDataCleanupCallback(CleanupEngineStats, GENERATOR_ENGINE_STATS);
+    }
+
+    // register statistics type
+    r = engine->RegisterObjectType("generatorStats", sizeof(SGeneratorStats), asOBJ_VALUE | asOBJ_POD | asGetTypeTraits<SGeneratorStats>()); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "uint executions", asOFFSET(SGeneratorStats, numExecutions)); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "uint yields", asOFFSET(SGeneratorStats, numYields)); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "uint gcObjectsCreated", asOFFSET(SGeneratorStats, numGCObjectsCreated)); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "uint gcObjectsDestroyed", asOFFSET(SGeneratorStats, numGCObjectsDestroyed)); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "double totalTime", asOFFSET(SGeneratorStats, totalTime)); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "double maxTime", asOFFSET(SGeneratorStats, maxTime)); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "double gcTime", asOFFSET(SGeneratorStats, gcTime)); assert(r >= 0);
+    r = engine->RegisterObjectProperty("generatorStats", "double yieldsPerSecond", asOFFSET(SGeneratorStats, yieldsPerSecond)); assert(r >= 0);
+
     // register generator object
     r = engine->RegisterObjectType("generator", sizeof(CGenerator), asOBJ_REF); assert(r >= 0);
+
+    // callbacks of the generator combinators
+    r = engine->RegisterFuncdef("void generatorMapFunc(const any&in value, any& result)"); assert(r >= 0);
+    r = engine->RegisterFuncdef("bool generatorFilterFunc(const any&in value)"); assert(r >= 0);
+    r = engine->RegisterFuncdef("void generatorZipFunc(const any&in value, const any&in otherValue, any& result)"); assert(r >= 0);
     if(strstr(asGetLibraryOptions(), "AS_MAX_PORTABILITY")==0)
     {
         // register generator object methods
@@ -314,14 +3920,122 @@ void RegisterGeneratorSupport(asIScriptEngine *engine)
         r = engine->RegisterObjectMethod("generator", "bool next(const int64&in)", asMETHODPR(CGenerator, Next, (asINT64&), bool), asCALL_THISCALL); assert(r >= 0);
         r = engine->RegisterObjectMethod("generator", "bool next(const double&in)", asMETHODPR(CGenerator, Next, (double&), bool), asCALL_THISCALL); assert(r >= 0);
         r = engine->RegisterObjectMethod("generator", "any& get_value() const", asMETHODPR(CGenerator, GetValue,(void)const,const CScriptAny*), asCALL_THISCALL); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "generatorStats get_stats() const", asMETHOD(CGenerator, GetStats), asCALL_THISCALL); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "void setQuota(uint lines, double us)", asMETHOD(CGenerator, SetQuota), asCALL_THISCALL); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "bool get_preempted() const", asMETHOD(CGenerator, WasPreempted), asCALL_THISCALL); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "void abort()", asMETHOD(CGenerator, Abort), asCALL_THISCALL); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "void abortAfter(double ms)", asMETHOD(CGenerator, AbortAfter), asCALL_THISCALL); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "bool get_aborted() const", asMETHOD(CGenerator, IsAborted), asCALL_THISCALL); assert( r >= 0 );
+        r = engine->RegisterGlobalFunction("generatorStats getGeneratorStats()", asFUNCTION(ScriptGetGeneratorEngineStats), asCALL_CDECL); assert(r >= 0);
+
+        // register foreach support
+        r = engine->RegisterObjectMethod("generator", "uint opForBegin()", asFUNCTION(ScriptGeneratorForBegin), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "bool opForEnd(uint) const", asFUNCTION(ScriptGeneratorForEnd), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "uint opForNext(uint)", asFUNCTION(ScriptGeneratorForNext), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "const any& opForValue(uint) const", asFUNCTION(ScriptGeneratorForValue), asCALL_CDECL_OBJLAST); assert(r >= 0);
+
+        // register native combinators
+        r = engine->RegisterObjectMethod("generator", "generator@ map(generatorMapFunc @+)", asFUNCTION(ScriptGeneratorMap), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ filter(generatorFilterFunc @+)", asFUNCTION(ScriptGeneratorFilter), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ take(uint)", asFUNCTION(ScriptGeneratorTake), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ skip(uint)", asFUNCTION(ScriptGeneratorSkip), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ zip(generator @+, generatorZipFunc @+)", asFUNCTION(ScriptGeneratorZip), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ chain(generator @+)", asFUNCTION(ScriptGeneratorChain), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        if (engine->GetTypeInfoByName("array"))
+        {
+            r = engine->RegisterObjectMethod("generator", "generator@ window(uint)", asFUNCTION(ScriptGeneratorWindow), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        }
         
         // register the associated global functions and types
         r = engine->RegisterGlobalFunction("any@ yield()", asFUNCTION(ScriptYield), asCALL_CDECL); assert(r >= 0);
         r = engine->RegisterGlobalFunction("any@ yield(?&in)", asFUNCTION(ScriptYieldObject), asCALL_CDECL); assert(r >= 0);
         r = engine->RegisterGlobalFunction("any@ yield(const int64&in)", asFUNCTION(ScriptYieldInt), asCALL_CDECL); assert(r >= 0);
         r = engine->RegisterGlobalFunction("any@ yield(const double&in)", asFUNCTION(ScriptYieldDouble), asCALL_CDECL); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void yieldFrom(?&in)", asFUNCTION(ScriptYieldFrom), asCALL_CDECL); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void waitFor(double)", asFUNCTION(ScriptWaitFor), asCALL_CDECL); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void waitUntilSample(int64)", asFUNCTION(ScriptWaitUntilSample), asCALL_CDECL); assert(r >= 0);
         r = engine->RegisterFuncdef("void generatorFunc(dictionary@)");
         r = engine->RegisterGlobalFunction("generator@ createGenerator(generatorFunc @+, dictionary @+)", asFUNCTION(ScriptCreateGenerator), asCALL_CDECL); assert(r >= 0);
+
+        // register typed generator template
+        r = engine->RegisterObjectType("typedGenerator<class T>", 0, asOBJ_REF | asOBJ_TEMPLATE); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("typedGenerator<T>", asBEHAVE_FACTORY, "typedGenerator<T>@ f(int&in, generatorFunc @+, dictionary @+)", asFUNCTION(ScriptCreateTypedGenerator), asCALL_CDECL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("typedGenerator<T>", asBEHAVE_ADDREF, "void f()", asMETHOD(CGenerator, AddRef), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("typedGenerator<T>", asBEHAVE_RELEASE, "void f()", asMETHOD(CGenerator, Release), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next()", asMETHODPR(CGenerator, Next, (void), bool), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next(?&in)", asMETHODPR(CGenerator, Next, (void*,int), bool), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next(const int64&in)", asMETHODPR(CGenerator, Next, (asINT64&), bool), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next(const double&in)", asMETHODPR(CGenerator, Next, (double&), bool), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "const T& get_value() const", asFUNCTION(ScriptGetTypedValue), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "generatorStats get_stats() const", asMETHOD(CGenerator, GetStats), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "void setQuota(uint lines, double us)", asMETHOD(CGenerator, SetQuota), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool get_preempted() const", asMETHOD(CGenerator, WasPreempted), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "void abort()", asMETHOD(CGenerator, Abort), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "void abortAfter(double ms)", asMETHOD(CGenerator, AbortAfter), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool get_aborted() const", asMETHOD(CGenerator, IsAborted), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "uint opForBegin()", asFUNCTION(ScriptGeneratorForBegin), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool opForEnd(uint) const", asFUNCTION(ScriptGeneratorForEnd), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "uint opForNext(uint)", asFUNCTION(ScriptGeneratorForNext), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "const T& opForValue(uint) const", asFUNCTION(ScriptTypedGeneratorForValue), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        if (engine->GetTypeInfoByName("array"))
+        {
+            r = engine->RegisterObjectMethod("typedGenerator<T>", "uint nextN(array<T>& values, uint max)", asMETHOD(CGenerator, NextN), asCALL_THISCALL); assert(r >= 0);
+        }
+
+        // creation with arguments forwarded to any generator function (generic in both modes)
+        RegisterGeneratorArgsOverloads(engine);
+
+        // register scheduler object (created by the host)
+        r = engine->RegisterObjectType("generatorScheduler", 0, asOBJ_REF); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("generatorScheduler", asBEHAVE_ADDREF, "void f()", asMETHOD(CGeneratorScheduler, AddRef), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("generatorScheduler", asBEHAVE_RELEASE, "void f()", asMETHOD(CGeneratorScheduler, Release), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generatorScheduler", "void add(generator@+)", asMETHOD(CGeneratorScheduler, Add), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generatorScheduler", "void remove(generator@+)", asMETHOD(CGeneratorScheduler, Remove), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generatorScheduler", "uint get_readyCount() const", asMETHOD(CGeneratorScheduler, GetReadyCount), asCALL_THISCALL); assert(r >= 0);
+
+        // register event object
+        r = engine->RegisterObjectType("event", 0, asOBJ_REF); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("event", asBEHAVE_FACTORY, "event@ f()", asFUNCTION(ScriptCreateEvent), asCALL_CDECL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("event", asBEHAVE_ADDREF, "void f()", asMETHOD(CGeneratorEvent, AddRef), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("event", asBEHAVE_RELEASE, "void f()", asMETHOD(CGeneratorEvent, Release), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "void signal()", asMETHOD(CGeneratorEvent, Signal), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "void reset()", asMETHOD(CGeneratorEvent, Reset), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "bool get_isSet() const", asMETHOD(CGeneratorEvent, IsSignaled), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "void wait()", asFUNCTION(ScriptEventWait), asCALL_CDECL_OBJLAST); assert(r >= 0);
+
+        // register cancellation token
+        r = engine->RegisterObjectType("cancellationToken", 0, asOBJ_REF); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("cancellationToken", asBEHAVE_FACTORY, "cancellationToken@ f()", asFUNCTION(ScriptCreateCancellationToken), asCALL_CDECL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("cancellationToken", asBEHAVE_ADDREF, "void f()", asMETHOD(CGeneratorCancellationToken, AddRef), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("cancellationToken", asBEHAVE_RELEASE, "void f()", asMETHOD(CGeneratorCancellationToken, Release), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "void cancel()", asMETHOD(CGeneratorCancellationToken, Cancel), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "bool get_isCancelled() const", asMETHOD(CGeneratorCancellationToken, IsCancelled), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "void add(?&in)", asFUNCTION(ScriptCancellationTokenAdd), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "void remove(?&in)", asFUNCTION(ScriptCancellationTokenRemove), asCALL_CDECL_OBJLAST); assert(r >= 0);
+
+        // register block adapter
+        if (engine->GetTypeInfoByName("array"))
+        {
+            r = engine->RegisterObjectType("blockAdapter", 0, asOBJ_REF); assert(r >= 0);
+            r = engine->RegisterObjectBehaviour("blockAdapter", asBEHAVE_FACTORY, "blockAdapter@ f(?&in, double sampleRate, bool linear = false)", asFUNCTION(ScriptCreateBlockAdapter), asCALL_CDECL); assert(r >= 0);
+            r = engine->RegisterObjectBehaviour("blockAdapter", asBEHAVE_ADDREF, "void f()", asMETHOD(CGeneratorBlockAdapter, AddRef), asCALL_THISCALL); assert(r >= 0);
+            r = engine->RegisterObjectBehaviour("blockAdapter", asBEHAVE_RELEASE, "void f()", asMETHOD(CGeneratorBlockAdapter, Release), asCALL_THISCALL); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "uint fill(array<double>& values, uint numSamples)", asMETHODPR(CGeneratorBlockAdapter, Fill, (CScriptArray*, asUINT), asUINT), asCALL_THISCALL); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "int64 get_position() const", asMETHOD(CGeneratorBlockAdapter, GetPosition), asCALL_THISCALL); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "bool get_done() const", asMETHOD(CGeneratorBlockAdapter, IsDone), asCALL_THISCALL); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "bool get_linear() const", asFUNCTION(ScriptBlockAdapterGetLinear), asCALL_CDECL_OBJLAST); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "void set_linear(bool)", asFUNCTION(ScriptBlockAdapterSetLinear), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        }
+
+        // register future template
+        r = engine->RegisterObjectType("future<class T>", 0, asOBJ_REF | asOBJ_TEMPLATE); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("future<T>", asBEHAVE_FACTORY, "future<T>@ f(int&in)", asFUNCTION(ScriptCreateFuture), asCALL_CDECL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("future<T>", asBEHAVE_ADDREF, "void f()", asMETHOD(CGeneratorFuture, AddRef), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("future<T>", asBEHAVE_RELEASE, "void f()", asMETHOD(CGeneratorFuture, Release), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("future<T>", "bool complete(const T&in)", asFUNCTION(ScriptFutureComplete), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterObjectMethod("future<T>", "bool get_isReady() const", asMETHOD(CGeneratorFuture, IsReady), asCALL_THISCALL); assert(r >= 0);
+        r = engine->RegisterObjectMethod("future<T>", "const T& get_value() const", asFUNCTION(ScriptFutureGetValue), asCALL_CDECL_OBJLAST); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void await(?&in)", asFUNCTION(ScriptAwait), asCALL_CDECL); assert(r >= 0);
     }
     else
     {
@@ -333,14 +4047,122 @@ void RegisterGeneratorSupport(asIScriptEngine *engine)
         r = engine->RegisterObjectMethod("generator", "bool next(const int64&in)", WRAP_MFN_PR(CGenerator, Next, (asINT64&), bool), asCALL_GENERIC); assert(r >= 0);
         r = engine->RegisterObjectMethod("generator", "bool next(const double&in)", WRAP_MFN_PR(CGenerator, Next, (double&), bool), asCALL_GENERIC); assert(r >= 0);
         r = engine->RegisterObjectMethod("generator", "any& get_value() const", WRAP_MFN_PR(CGenerator, GetValue,(void)const,const CScriptAny*), asCALL_GENERIC); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "generatorStats get_stats() const", WRAP_MFN(CGenerator, GetStats), asCALL_GENERIC); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "void setQuota(uint lines, double us)", WRAP_MFN(CGenerator, SetQuota), asCALL_GENERIC); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "bool get_preempted() const", WRAP_MFN(CGenerator, WasPreempted), asCALL_GENERIC); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "void abort()", WRAP_MFN(CGenerator, Abort), asCALL_GENERIC); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "void abortAfter(double ms)", WRAP_MFN(CGenerator, AbortAfter), asCALL_GENERIC); assert( r >= 0 );
+        r = engine->RegisterObjectMethod("generator", "bool get_aborted() const", WRAP_MFN(CGenerator, IsAborted), asCALL_GENERIC); assert( r >= 0 );
+        r = engine->RegisterGlobalFunction("generatorStats getGeneratorStats()", WRAP_FN(ScriptGetGeneratorEngineStats), asCALL_GENERIC); assert(r >= 0);
+
+        // register foreach support
+        r = engine->RegisterObjectMethod("generator", "uint opForBegin()", WRAP_OBJ_LAST(ScriptGeneratorForBegin), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "bool opForEnd(uint) const", WRAP_OBJ_LAST(ScriptGeneratorForEnd), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "uint opForNext(uint)", WRAP_OBJ_LAST(ScriptGeneratorForNext), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "const any& opForValue(uint) const", WRAP_OBJ_LAST(ScriptGeneratorForValue), asCALL_GENERIC); assert(r >= 0);
+
+        // register native combinators
+        r = engine->RegisterObjectMethod("generator", "generator@ map(generatorMapFunc @+)", WRAP_OBJ_LAST(ScriptGeneratorMap), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ filter(generatorFilterFunc @+)", WRAP_OBJ_LAST(ScriptGeneratorFilter), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ take(uint)", WRAP_OBJ_LAST(ScriptGeneratorTake), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ skip(uint)", WRAP_OBJ_LAST(ScriptGeneratorSkip), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ zip(generator @+, generatorZipFunc @+)", WRAP_OBJ_LAST(ScriptGeneratorZip), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generator", "generator@ chain(generator @+)", WRAP_OBJ_LAST(ScriptGeneratorChain), asCALL_GENERIC); assert(r >= 0);
+        if (engine->GetTypeInfoByName("array"))
+        {
+            r = engine->RegisterObjectMethod("generator", "generator@ window(uint)", WRAP_OBJ_LAST(ScriptGeneratorWindow), asCALL_GENERIC); assert(r >= 0);
+        }
         
         // register the associated global functions and types
         r = engine->RegisterGlobalFunction("any@ yield()", WRAP_FN(ScriptYield), asCALL_GENERIC); assert(r >= 0);
         r = engine->RegisterGlobalFunction("any@ yield(?&in)", WRAP_FN(ScriptYieldObject), asCALL_GENERIC); assert(r >= 0);
         r = engine->RegisterGlobalFunction("any@ yield(const int64&in)", WRAP_FN(ScriptYieldInt), asCALL_GENERIC); assert(r >= 0);
         r = engine->RegisterGlobalFunction("any@ yield(const double&in)", WRAP_FN(ScriptYieldDouble), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void yieldFrom(?&in)", WRAP_FN(ScriptYieldFrom), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void waitFor(double)", WRAP_FN(ScriptWaitFor), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void waitUntilSample(int64)", WRAP_FN(ScriptWaitUntilSample), asCALL_GENERIC); assert(r >= 0);
         r = engine->RegisterFuncdef("void generatorFunc(dictionary@)");
         r = engine->RegisterGlobalFunction("generator@ createGenerator(generatorFunc @+, dictionary @+)", WRAP_FN(ScriptCreateGenerator), asCALL_GENERIC); assert(r >= 0);
+
+        // register typed generator template
+        r = engine->RegisterObjectType("typedGenerator<class T>", 0, asOBJ_REF | asOBJ_TEMPLATE); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("typedGenerator<T>", asBEHAVE_FACTORY, "typedGenerator<T>@ f(int&in, generatorFunc @+, dictionary @+)", WRAP_FN(ScriptCreateTypedGenerator), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("typedGenerator<T>", asBEHAVE_ADDREF, "void f()", WRAP_MFN(CGenerator, AddRef), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("typedGenerator<T>", asBEHAVE_RELEASE, "void f()", WRAP_MFN(CGenerator, Release), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next()", WRAP_MFN_PR(CGenerator, Next, (void), bool), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next(?&in)", WRAP_MFN_PR(CGenerator, Next, (void*,int), bool), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next(const int64&in)", WRAP_MFN_PR(CGenerator, Next, (asINT64&), bool), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool next(const double&in)", WRAP_MFN_PR(CGenerator, Next, (double&), bool), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "const T& get_value() const", WRAP_OBJ_LAST(ScriptGetTypedValue), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "generatorStats get_stats() const", WRAP_MFN(CGenerator, GetStats), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "void setQuota(uint lines, double us)", WRAP_MFN(CGenerator, SetQuota), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool get_preempted() const", WRAP_MFN(CGenerator, WasPreempted), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "void abort()", WRAP_MFN(CGenerator, Abort), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "void abortAfter(double ms)", WRAP_MFN(CGenerator, AbortAfter), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool get_aborted() const", WRAP_MFN(CGenerator, IsAborted), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "uint opForBegin()", WRAP_OBJ_LAST(ScriptGeneratorForBegin), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "bool opForEnd(uint) const", WRAP_OBJ_LAST(ScriptGeneratorForEnd), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "uint opForNext(uint)", WRAP_OBJ_LAST(ScriptGeneratorForNext), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("typedGenerator<T>", "const T& opForValue(uint) const", WRAP_OBJ_LAST(ScriptTypedGeneratorForValue), asCALL_GENERIC); assert(r >= 0);
+        if (engine->GetTypeInfoByName("array"))
+        {
+            r = engine->RegisterObjectMethod("typedGenerator<T>", "uint nextN(array<T>& values, uint max)", WRAP_MFN(CGenerator, NextN), asCALL_GENERIC); assert(r >= 0);
+        }
+
+        // creation with arguments forwarded to any generator function (generic in both modes)
+        RegisterGeneratorArgsOverloads(engine);
+
+        // register scheduler object (created by the host)
+        r = engine->RegisterObjectType("generatorScheduler", 0, asOBJ_REF); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("generatorScheduler", asBEHAVE_ADDREF, "void f()", WRAP_MFN(CGeneratorScheduler, AddRef), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("generatorScheduler", asBEHAVE_RELEASE, "void f()", WRAP_MFN(CGeneratorScheduler, Release), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generatorScheduler", "void add(generator@+)", WRAP_MFN(CGeneratorScheduler, Add), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generatorScheduler", "void remove(generator@+)", WRAP_MFN(CGeneratorScheduler, Remove), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("generatorScheduler", "uint get_readyCount() const", WRAP_MFN(CGeneratorScheduler, GetReadyCount), asCALL_GENERIC); assert(r >= 0);
+
+        // register event object
+        r = engine->RegisterObjectType("event", 0, asOBJ_REF); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("event", asBEHAVE_FACTORY, "event@ f()", WRAP_FN(ScriptCreateEvent), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("event", asBEHAVE_ADDREF, "void f()", WRAP_MFN(CGeneratorEvent, AddRef), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("event", asBEHAVE_RELEASE, "void f()", WRAP_MFN(CGeneratorEvent, Release), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "void signal()", WRAP_MFN(CGeneratorEvent, Signal), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "void reset()", WRAP_MFN(CGeneratorEvent, Reset), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "bool get_isSet() const", WRAP_MFN(CGeneratorEvent, IsSignaled), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("event", "void wait()", WRAP_OBJ_LAST(ScriptEventWait), asCALL_GENERIC); assert(r >= 0);
+
+        // register cancellation token
+        r = engine->RegisterObjectType("cancellationToken", 0, asOBJ_REF); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("cancellationToken", asBEHAVE_FACTORY, "cancellationToken@ f()", WRAP_FN(ScriptCreateCancellationToken), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("cancellationToken", asBEHAVE_ADDREF, "void f()", WRAP_MFN(CGeneratorCancellationToken, AddRef), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("cancellationToken", asBEHAVE_RELEASE, "void f()", WRAP_MFN(CGeneratorCancellationToken, Release), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "void cancel()", WRAP_MFN(CGeneratorCancellationToken, Cancel), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "bool get_isCancelled() const", WRAP_MFN(CGeneratorCancellationToken, IsCancelled), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "void add(?&in)", WRAP_OBJ_LAST(ScriptCancellationTokenAdd), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("cancellationToken", "void remove(?&in)", WRAP_OBJ_LAST(ScriptCancellationTokenRemove), asCALL_GENERIC); assert(r >= 0);
+
+        // register block adapter
+        if (engine->GetTypeInfoByName("array"))
+        {
+            r = engine->RegisterObjectType("blockAdapter", 0, asOBJ_REF); assert(r >= 0);
+            r = engine->RegisterObjectBehaviour("blockAdapter", asBEHAVE_FACTORY, "blockAdapter@ f(?&in, double sampleRate, bool linear = false)", WRAP_FN(ScriptCreateBlockAdapter), asCALL_GENERIC); assert(r >= 0);
+            r = engine->RegisterObjectBehaviour("blockAdapter", asBEHAVE_ADDREF, "void f()", WRAP_MFN(CGeneratorBlockAdapter, AddRef), asCALL_GENERIC); assert(r >= 0);
+            r = engine->RegisterObjectBehaviour("blockAdapter", asBEHAVE_RELEASE, "void f()", WRAP_MFN(CGeneratorBlockAdapter, Release), asCALL_GENERIC); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "uint fill(array<double>& values, uint numSamples)", WRAP_MFN_PR(CGeneratorBlockAdapter, Fill, (CScriptArray*, asUINT), asUINT), asCALL_GENERIC); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "int64 get_position() const", WRAP_MFN(CGeneratorBlockAdapter, GetPosition), asCALL_GENERIC); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "bool get_done() const", WRAP_MFN(CGeneratorBlockAdapter, IsDone), asCALL_GENERIC); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "bool get_linear() const", WRAP_OBJ_LAST(ScriptBlockAdapterGetLinear), asCALL_GENERIC); assert(r >= 0);
+            r = engine->RegisterObjectMethod("blockAdapter", "void set_linear(bool)", WRAP_OBJ_LAST(ScriptBlockAdapterSetLinear), asCALL_GENERIC); assert(r >= 0);
+        }
+
+        // register future template
+        r = engine->RegisterObjectType("future<class T>", 0, asOBJ_REF | asOBJ_TEMPLATE); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("future<T>", asBEHAVE_FACTORY, "future<T>@ f(int&in)", WRAP_FN(ScriptCreateFuture), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("future<T>", asBEHAVE_ADDREF, "void f()", WRAP_MFN(CGeneratorFuture, AddRef), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectBehaviour("future<T>", asBEHAVE_RELEASE, "void f()", WRAP_MFN(CGeneratorFuture, Release), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("future<T>", "bool complete(const T&in)", WRAP_OBJ_LAST(ScriptFutureComplete), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("future<T>", "bool get_isReady() const", WRAP_MFN(CGeneratorFuture, IsReady), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterObjectMethod("future<T>", "const T& get_value() const", WRAP_OBJ_LAST(ScriptFutureGetValue), asCALL_GENERIC); assert(r >= 0);
+        r = engine->RegisterGlobalFunction("void await(?&in)", WRAP_FN(ScriptAwait), asCALL_GENERIC); assert(r >= 0);
     }
 }
 END_AS_NAMESPACE
@@ -6,20 +6,176 @@
 #include <angelscript.h>
 #endif
 
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <iterator>
+#include <cstddef>
+
 BEGIN_AS_NAMESPACE
 
 #include "../scriptany/scriptany.h"
 
 class CScriptDictionary;
+class CScriptArray;
+class CGeneratorEvent;
+class CGeneratorFuture;
+class CGeneratorScheduler;
+class CGeneratorArena;
+class CGeneratorCombinator;
+class CGeneratorCancellationToken;
+class CGeneratorBlockAdapter;
+struct SGeneratorEngineStats;
+
+// Execution statistics for a generator, or for all the generators of an engine.
+// Times are in microseconds.
+// Times are only measured when statistics are enabled (EnableGeneratorStats for the 
+// engine, or CGenerator::EnableStats), as they require reading the clock on each next().
+struct SGeneratorStats
+{
+    asUINT  numExecutions;
+    asUINT  numYields;
+    asUINT  numGCObjectsCreated;
+    asUINT  numGCObjectsDestroyed;
+    double  totalTime;          // total time spent in next() (including GC)
+    double  maxTime;            // longest single next()
+    double  gcTime;             // time spent in garbage collection in next()
+    double  yieldsPerSecond;    // yields per second since creation (or registration)
+};
+
+// Memory accounting for a generator. Allocations are only attributed to generators
+// when the accounting memory functions are installed (EnableGeneratorMemoryAccounting).
+struct SGeneratorMemoryStats
+{
+    asQWORD bytesAllocated;     // allocated with the engine memory functions while running
+    asQWORD bytesFreed;         // freed with the engine memory functions while running
+    asUINT  numGCObjectsCreated;
+    asUINT  maxCallstackSize;   // deepest call stack seen (when suspended, or checking limits)
+};
+
+/** Context pool dedicated to generators. Contexts are created up front when
+*   generator support is registered and recycled when generators are done, so
+*   that creating a generator does not create a new context every time. The stack
+*   of a context is only allocated when it is first prepared: call Warmup() once 
+*   the scripts are built so that creating generators does not allocate either.
+*   Contexts get the initial stack size of the engine (asEP_INIT_STACK_SIZE, set by the host).
+*   Contexts are requested by the thread that creates the generators, and can be
+*   returned from any thread (generators completed by executor workers).
+*/
+class CGeneratorContextPool
+{
+public:
+    // size: max number of idle contexts kept in the pool (all created up front)
+    CGeneratorContextPool(asIScriptEngine* engine, asUINT size);
+    ~CGeneratorContextPool();
+
+    // Get a context from the pool, or create a new one if the pool is empty
+    asIScriptContext* RequestContext();
+    // Give a context back to the pool, or release it if the pool is full
+    void ReturnContext(asIScriptContext* context);
+    // Release all idle contexts (they hold a reference to the engine)
+    void Clear();
+    // Prepares all idle contexts once with func, so that their stacks are allocated up front
+    void Warmup(asIScriptFunction* func);
+
+    asIScriptEngine* GetEngine() const;
+
+    // Statistics
+    asUINT GetSize() const;
+    asUINT GetNumAvailable() const;
+    asUINT GetNumHits() const;
+    asUINT GetNumMisses() const;
+    void   ResetStatistics();
+protected:
+    asIScriptEngine*                engine;
+    asUINT                          size;
+    std::vector<asIScriptContext*>  contexts;
+    asUINT                          numHits;
+    asUINT                          numMisses;
+    mutable std::mutex              mutex;
+};
+
+/** Garbage collection policy applied by generators after each execution step.
+*   Can be set for the whole engine or per generator, and subclassed for custom
+*   behaviors. Policies are owned by the host and must outlive the generators.
+*   - kGCFullCycle: full cycle if new objects were created + one incremental step (default)
+*   - kGCNever: no garbage collection at all from generators
+*   - kGCBudget: incremental steps, within a budget of steps and/or time per frame
+*   - kGCDeferred: nothing done in generators, the host calls Collect() when appropriate
+*/
+class CGeneratorGCPolicy
+{
+public:
+    enum Mode
+    {
+        kGCFullCycle,
+        kGCNever,
+        kGCBudget,
+        kGCDeferred
+    };
+
+    CGeneratorGCPolicy(Mode mode=kGCFullCycle);
+    virtual ~CGeneratorGCPolicy();
+
+    void SetMode(Mode mode);
+    Mode GetMode() const;
+
+    // Budget for kGCBudget mode: max number of incremental steps and/or max time
+    // in microseconds spent per frame (0 for no limit)
+    void SetBudget(asUINT maxStepsPerFrame, asUINT maxMicrosecondsPerFrame);
+    // Starts a new frame: resets the budget consumed so far (to be called by the host)
+    void NewFrame();
+
+    // Returns true if the generator should gather GC statistics around execution
+    virtual bool UsesGCStatistics() const;
+    // Called by the generator after each execution step, with the number of objects
+    // created in the GC during the step (when UsesGCStatistics() is true).
+    // Returns the number of objects destroyed.
+    virtual asUINT AfterExecute(asIScriptEngine* engine, asUINT numNewObjects);
+    // Full garbage collection, to be called by the host (for kGCDeferred mode).
+    // Returns the number of objects destroyed.
+    virtual asUINT Collect(asIScriptEngine* engine);
+protected:
+    Mode    mode;
+    asUINT  maxStepsPerFrame;
+    asUINT  maxMicrosecondsPerFrame;
+    asUINT  frameSteps;
+    double  frameMicroseconds;
+};
+
 /** A simple generator add-on for Angelscript to manage
 *   coroutines like in javascript, using yield() and next() statements.
 *   status: WIP.
-*   todo: manage return / abort ? ("terminate"?)
 */
 class CGenerator
 {
+    friend class CGeneratorTimerWheel;
+    friend class CGeneratorScheduler;
+    friend class CGeneratorArena;
+    friend class CGeneratorCombinator;
+    friend class CGeneratorCancellationToken;
 public:
-    CGenerator(asIScriptContext *context);
+    // Wait requested by the script (waitFor / waitUntilSample) during the last step
+    enum WaitMode
+    {
+        kWaitNone,
+        kWaitDuration,
+        kWaitUntilSample,
+        kWaitEvent,
+        kWaitFuture
+    };
+
+    // valueType is the typedGenerator<T> template instance for typed generators,
+    // NULL for untyped generators (values stored in an any object)
+    // arena: the arena the generator is created in (see CGeneratorArena::Create)
+    CGenerator(asIScriptContext *context, asITypeInfo *valueType=NULL, CGeneratorArena* arena=NULL);
+    // untyped generator computing its values natively with a combinator (owned)
+    CGenerator(asIScriptEngine *engine, CGeneratorCombinator* combinator);
     ~CGenerator();
 
     // Memory management
@@ -34,39 +190,829 @@ public:
     bool Next(asINT64 &value);
     bool Next(double &value);
 
-    // Abort 
-    //void Abort();
+    // Resumes the generator up to maxCount times and stores the yielded values
+    // into the array (resized to the number of values). Stops early when the 
+    // generator is done or preempted. Returns the number of values.
+    asUINT NextN(CScriptArray* values, asUINT maxCount);
+
+    // value for untyped generators (NULL for typed generators)
     const CScriptAny* GetValue()const;
     CScriptAny* GetValue();
 
-    // creates and stores a new value for next yield return
+    // Stores the value sent back to the caller (converted to T for typed generators)
+    // Returns false if the value cannot be converted.
+    bool StoreValue(void *ref, int refTypeId);
+    void ClearValue();
+    // value for typed generators: address of the value of type T
+    // (the pointer to the object itself for non-handle object types)
+    const void* GetTypedValue() const;
+    // Type id of the values of a typed generator (asTYPEID_VOID for untyped generators)
+    int GetValueTypeId() const;
+
+    // returns the value container for next yield return (with a reference for the caller).
+    // Containers are reused: a new one is only allocated if the script still holds both buffers
+    // (for arena generators, NULL is returned instead)
     CScriptAny* NewYieldReturnPtr(asIScriptEngine* engine);
+
+    // Garbage collection policy for this generator (NULL to use the engine policy)
+    void SetGCPolicy(CGeneratorGCPolicy* policy);
+    CGeneratorGCPolicy* GetGCPolicy() const;
+
+    // Execution statistics (times are measured if enabled for this generator or the engine)
+    SGeneratorStats GetStats() const;
+    void EnableStats(bool enable);
+
+    // Preemption quota for each resume (0 for no limit), enforced with the context
+    // line callback: when the script runs more than maxLines lines or longer than 
+    // maxMicroseconds without yielding, it is suspended like an implicit yield
+    // (Next() returns true without any value).
+    void   SetQuota(asUINT maxLines, double maxMicroseconds);
+    asUINT GetLineQuota() const;
+    double GetTimeQuota() const;
+    // true if the last resume was preempted (suspended by the quota, not done)
+    bool   WasPreempted() const;
+
+    // Resumes the generator until it yields a value, resuming preempted steps
+    // again (used for iteration). Returns false when the generator is done.
+    bool   NextValue();
+    // true when the generator has finished its execution
+    bool   IsDone() const;
+
+    // Aborts the generator (and its delegates): the suspended context is unwound, 
+    // releasing the objects on its stack, and returned to the pool immediately. If the
+    // generator is running, its execution is aborted when it gets control back.
+    void   Abort();
+    // Aborts the generator if it is resumed more than timeout milliseconds from now
+    // (0 to remove the timeout). Generators that are not resumed anymore are aborted
+    // by AbortIfExpired(), or by CGeneratorScheduler::AbortExpired() when scheduled.
+    void   AbortAfter(double milliseconds);
+    // Aborts the generator now if its timeout has expired. Returns true if aborted.
+    bool   AbortIfExpired();
+    bool   IsAborted() const;
+
+    // Script exception that terminated the generator (or one of its delegates), kept 
+    // for the host as it is only forwarded to the active context if any (none on the 
+    // executor workers). NULL, NULL and 0 if the generator did not raise an exception.
+    const char*        GetExceptionString() const;
+    asIScriptFunction* GetExceptionFunction() const;
+    int                GetExceptionLineNumber() const;
+
+    // Memory accounting and limits (0 for no limit), checked with the context line 
+    // callback: a script exception is raised when the net bytes allocated while running
+    // (allocated - freed) or the call stack depth exceed the limits.
+    SGeneratorMemoryStats GetMemoryStats() const;
+    void   SetMemoryLimits(asQWORD maxBytes, asUINT maxCallstackSize);
+    // Suspends the generator until some time has elapsed or until a sample position 
+    // is reached. Handled by the scheduler (acts like yield otherwise).
+    void     WaitFor(double milliseconds);
+    void     WaitUntilSample(asINT64 samplePosition);
+    // Suspends the generator until the event is signaled. Handled by the scheduler.
+    void     WaitEvent(CGeneratorEvent* event);
+    // Suspends the generator until the future is completed. Handled by the scheduler.
+    void     WaitFuture(CGeneratorFuture* future);
+    WaitMode GetWaitMode() const;
+    double   GetWaitDuration() const;
+    asINT64  GetWaitSamplePosition() const;
+    CGeneratorEvent* GetWaitEvent() const;
+    CGeneratorFuture* GetWaitFuture() const;
+
+    // Delegates execution to another generator until it is done (yieldFrom):
+    // values of the delegate are directly forwarded to the caller of Next().
+    // Returns false if the delegate cannot be used.
+    bool Delegate(CGenerator* generator);
+
+    // Lazy combinators evaluated natively (untyped generators only), returning a new
+    // generator. Values sent with Next() are not forwarded to the sources.
+    // map: func(value, result) called for each value
+    // filter: values for which func(value) returns true
+    // take / skip: first count values / all values but the first count values
+    // zip: func(value, otherValue, result) called for each pair of values (until one is done)
+    // chain: values of this generator, then values of other
+    // window: arrays of the last count values (array<any@>), when count values are available
+    CGenerator* Map(asIScriptFunction* func);
+    CGenerator* Filter(asIScriptFunction* func);
+    CGenerator* Take(asUINT count);
+    CGenerator* Skip(asUINT count);
+    CGenerator* Zip(CGenerator* other, asIScriptFunction* func);
+    CGenerator* Chain(CGenerator* other);
+    CGenerator* Window(asUINT count);
+
+    // engine of the generator
+    asIScriptEngine* GetEngine() const;
 protected:
+    // creates a combinator generator over this one (kind: CGeneratorCombinator::Kind)
+    CGenerator* Combine(int kind, CGenerator* other, asIScriptFunction* func, asUINT count);
     bool        DoNext();
+    // runs the context of this generator only (not its delegates), with the 
+    // preemption quota of root (the outermost generator)
+    bool        ExecuteStep(CGenerator* root);
+    // context line callback enforcing the limits of the generator and the quota of its root
+    static void ExecutionLineCallback(asIScriptContext* context, CGenerator* generator);
+    // the generator holding the current value (innermost active delegate or this)
+    const CGenerator* GetValueSource() const;
 
     // our reference counter for the generator object
     mutable int refCount;
+    asIScriptEngine* engine;
 
     // Statistics for Garbage Collection
     asUINT   m_numExecutions;
     asUINT   m_numGCObjectsCreated;
     asUINT   m_numGCObjectsDestroyed;
 
+    // Timing statistics (microseconds)
+    asUINT   m_numYields;
+    double   m_totalTime;
+    double   m_maxTime;
+    double   m_gcTime;
+    std::chrono::steady_clock::time_point m_creationTime;
+    bool     m_statsEnabled;
+    // engine-wide statistics (owned by the engine)
+    SGeneratorEngineStats* m_engineStats;
+
+    // delegation (yieldFrom): the generator this one delegates to (referenced),
+    // the generator that delegates to this one, and for the outermost generator
+    // the innermost active delegate, which is resumed directly
+    CGenerator* delegate;
+    CGenerator* delegator;
+    CGenerator* activeDelegate;
+
+    // the garbage collection policy (not owned, NULL for engine policy)
+    CGeneratorGCPolicy* gcPolicy;
+
+    // native combinator computing the values (owned, NULL for script generators)
+    CGeneratorCombinator* combinator;
+
+    // abort state, timeout and cancellation token (not referenced)
+    bool         aborted;
+    bool         hasAbortTime;
+    std::chrono::steady_clock::time_point abortTime;
+    CGeneratorCancellationToken* cancellationToken;
+
+    // script exception that terminated the generator (function referenced)
+    void         StoreException(asIScriptContext* context);
+    bool               hasException;
+    std::string        exceptionString;
+    asIScriptFunction* exceptionFunction;
+    int                exceptionLine;
+    // copies the wait requested by another generator (driven by a combinator)
+    void ForwardWait(const CGenerator* from);
+
+    // the arena that owns this generator (NULL if allocated on the heap), and the 
+    // pool the context is returned to (NULL for the default pool, unused for arena
+    // generators: the context is returned to the arena)
+    CGeneratorArena*       arena;
+    CGeneratorContextPool* contextPool;
+    // returns the context (done, aborted or destroyed) to the arena or the pool
+    void         ReleaseContext();
+
+    // preemption quota, and state of the current resume
+    asUINT       quotaLines;
+    double       quotaTime;
+    bool         preempted;
+    asUINT       quotaLineCount;
+    std::chrono::steady_clock::time_point quotaDeadline;
+    CGenerator*  quotaRoot;
+
+    // memory accounting and limits
+    SGeneratorMemoryStats m_memoryStats;
+    asQWORD      memoryLimit;
+    asUINT       callstackLimit;
+
+    // links in a list of sleeping generators (timer wheel slot or generators waiting for
+    // an event): a generator is in one list at most
+    void         LinkTo(CGenerator** list);
+    void         Unlink();
+
+    // wait request, and list links when sleeping
+    WaitMode     waitMode;
+    double       waitDuration;
+    asINT64      waitSamplePosition;
+    CGeneratorEvent* waitEvent;
+    CGeneratorFuture* waitFuture;
+    asINT64      wakeTime;
+    CGenerator*  linkPrev;
+    CGenerator*  linkNext;
+    CGenerator** linkList;
+
     // the context associated with the generator object
     asIScriptContext * ctx;
     // the value for the next yield return (sent from caller to callee)
     CScriptAny* yieldReturn;
+    // reusable containers for yield return values, double buffered since the 
+    // script may still hold the previous one when yielding again
+    CScriptAny* yieldReturnBuffers[2];
+    int         yieldReturnBaseRefCounts[2];
     // the value associated with the generator (sent back to caller)
     CScriptAny* value;
+
+    // typed generators: primitives and handles are stored inline, without boxing
+    asITypeInfo*    valueType;
+    int             valueTypeId;
+    union
+    {
+        asINT64     i;
+        double      d;
+        void*       obj;
+    } typedValue;
 };
 
+/** STL-style input iterator over the values of a generator (single pass), for example:
+*   for (CGenerator& step : *generator) { step.GetValue()->Retrieve(...); }
+*   Dereferencing gives the generator, positioned on its current value.
+*/
+class CGeneratorIterator
+{
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef CGenerator              value_type;
+    typedef std::ptrdiff_t          difference_type;
+    typedef CGenerator*             pointer;
+    typedef CGenerator&             reference;
+
+    // end iterator
+    CGeneratorIterator();
+    // resumes the generator to its first value
+    explicit CGeneratorIterator(CGenerator* generator);
+
+    reference operator*() const;
+    pointer operator->() const;
+    CGeneratorIterator& operator++();
+    CGeneratorIterator operator++(int);
+    bool operator==(const CGeneratorIterator& other) const;
+    bool operator!=(const CGeneratorIterator& other) const;
+protected:
+    // NULL once the generator is done
+    CGenerator* generator;
+};
+
+// range-based for loops support
+CGeneratorIterator begin(CGenerator& generator);
+CGeneratorIterator end(CGenerator& generator);
+
+/** Lazy combinator over generators, evaluated natively when the generator that owns
+*   it is resumed: sources are resumed on demand, and callbacks are called in the 
+*   context of the caller when possible (one script call per callback). Waits and
+*   preemptions of the sources are forwarded to the combinator generator.
+*/
+class CGeneratorCombinator
+{
+public:
+    enum Kind
+    {
+        kMap,
+        kFilter,
+        kTake,
+        kSkip,
+        kZip,
+        kChain,
+        kWindow
+    };
+    // result of a step
+    enum Step
+    {
+        kStepValue,
+        kStepSuspended,
+        kStepDone
+    };
+
+    // keeps a reference to the sources and the callback
+    CGeneratorCombinator(Kind kind, CGenerator* source, CGenerator* other, asIScriptFunction* callback, asUINT count);
+    ~CGeneratorCombinator();
+
+    // computes the next value into result (for the generator root, which receives
+    // waits and preemptions of the sources)
+    Step Next(CScriptAny* result, CGenerator* root);
+protected:
+    Step NextSource(CGenerator* generator, CGenerator* root);
+    bool Call(CScriptAny* arg1, CScriptAny* arg2, CScriptAny* result, bool* returnValue);
+    void ReleaseSources();
+
+    Kind                    kind;
+    CGenerator*             source;
+    CGenerator*             other;
+    asIScriptFunction*      callback;
+    asUINT                  count;
+    asUINT                  position;
+    // zip: the value of the source is ready, waiting for the other
+    bool                    sourceReady;
+    // window: the last values (copies) and the array type
+    std::deque<CScriptAny*> windowValues;
+    asITypeInfo*            windowArrayType;
+};
+
+/** Fixed-capacity arena for real-time threads: generator objects, contexts and value
+*   containers are reserved up front, so that creating, resuming and destroying 
+*   generators of the arena does not allocate memory nor take any lock in the add-on.
+*   When the arena is exhausted, creation fails (returns NULL) instead of falling back 
+*   to the heap. The arena is not thread safe: generators must be created and released 
+*   on the thread that owns the arena, and all of them released before it is destroyed.
+*   Typed generators of object values (not handles) cannot be created in the arena. 
+*   The GC policy should not collect on the real-time thread (use kGCDeferred), and 
+*   the script itself must not allocate objects to be fully allocation-free.
+*/
+class CGeneratorArena
+{
+    friend class CGenerator;
+public:
+    // capacity: max number of generators alive at the same time
+    // gcPolicy: policy for the generators of the arena (NULL for the engine policy)
+    CGeneratorArena(asIScriptEngine* engine, asUINT capacity, CGeneratorGCPolicy* gcPolicy=NULL);
+    ~CGeneratorArena();
+
+    // Prepares all contexts once with func, so that their stacks are allocated up front
+    // (with the initial stack size of the engine, asEP_INIT_STACK_SIZE)
+    void Warmup(asIScriptFunction* func);
+
+    // Creates a generator for func (function or delegate), forwarding the arguments 
+    // (converted to the parameter types). valueType is the typedGenerator<T> instance 
+    // for typed generators. Returns NULL if the arena is full or the arguments do not match.
+    CGenerator* Create(asIScriptFunction* func, asUINT numArgs=0, void** refs=NULL, const int* refTypeIds=NULL, asITypeInfo* valueType=NULL);
+
+    asIScriptEngine* GetEngine() const;
+    asUINT GetCapacity() const;
+    asUINT GetNumAvailable() const;
+    // number of creations that failed because the arena was full (or the value 
+    // container of the next slot is still held by a script)
+    asUINT GetNumFailures() const;
+protected:
+    // destroys a generator of the arena and makes its slot available
+    void Free(CGenerator* generator);
+    // gives the context of a generator back to the free list of the arena
+    void ReturnContext(asIScriptContext* context);
+
+    // value containers reserved for each generator (the arena keeps a reference), 
+    // with their ref counts when only referenced by the arena (and the GC)
+    struct Slot
+    {
+        CScriptAny* value;
+        CScriptAny* yieldReturnBuffers[2];
+        int         valueBaseRefCount;
+        int         yieldReturnBaseRefCounts[2];
+    };
+    asIScriptEngine*        engine;
+    asUINT                  capacity;
+    CGenerator*             generators;
+    std::vector<Slot>       slots;
+    std::vector<asUINT>     freeSlots;
+    // free contexts (owned, not locked: the arena is used by one thread)
+    std::vector<asIScriptContext*> contexts;
+    CGeneratorGCPolicy*     gcPolicy;
+    SGeneratorEngineStats*  engineStats;
+    asUINT                  numFailures;
+};
+
+/** Hierarchical timer wheel for sleeping generators: 4 levels of 256 slots, with
+*   one tick per sample at the first level. Generators are linked in place, so 
+*   inserting, removing and waking up generators does not allocate memory, and 
+*   advancing time only touches the generators that are due (and the ones moved
+*   to a lower level when a higher level slot is reached).
+*/
+class CGeneratorTimerWheel
+{
+public:
+    CGeneratorTimerWheel();
+
+    // Inserts a generator that should wake up at wakeTime (must be later than current time)
+    void    Insert(CGenerator* generator, asINT64 wakeTime);
+    // Removes a generator from the wheel. Returns false if it was not in the wheel
+    bool    Remove(CGenerator* generator);
+    // Advances the time up to the given time, appending the generators that are due
+    void    Advance(asINT64 time, std::deque<CGenerator*>& dueGenerators);
+    // Removes all generators, appending them to the given queue
+    void    RemoveAll(std::deque<CGenerator*>& generators);
+    // Appends the generators of the wheel that have an abort timeout (see AbortAfter)
+    void    GetAbortable(std::vector<CGenerator*>& generators) const;
+
+    asINT64 GetTime() const;
+    asUINT  GetCount() const;
+protected:
+    enum
+    {
+        kLevelBits = 8,
+        kNumSlots = 1 << kLevelBits,
+        kNumLevels = 4
+    };
+    void    Link(CGenerator* generator, CGenerator** slot);
+    void    Unlink(CGenerator* generator);
+    void    Cascade(int level);
+
+    asINT64     time;
+    asUINT      count;
+    CGenerator* slots[kNumLevels][kNumSlots];
+};
+
+/** Event that generators can wait for (manual reset): waiting generators are 
+*   suspended by the scheduler until the event is signaled. Signaling the event
+*   moves its waiters (and only them) to the ready queue of their scheduler.
+*   Waiting for an event that is already signaled does not suspend the generator.
+*   Not thread safe: should be used from the thread that runs the scheduler.
+*/
+class CGeneratorEvent
+{
+public:
+    CGeneratorEvent();
+
+    // Memory management
+    int AddRef() const;
+    int Release() const;
+
+    // Signals the event and wakes up all waiting generators
+    void Signal();
+    // Resets the event to the non signaled state
+    void Reset();
+    bool IsSignaled() const;
+    asUINT GetWaiterCount() const;
+
+    // Waiters management (used by the scheduler)
+    void AddWaiter(CGenerator* generator, CGeneratorScheduler* scheduler);
+    void RemoveWaiter(CGenerator* generator);
+protected:
+    ~CGeneratorEvent();
+
+    struct Waiter
+    {
+        CGenerator*          generator;
+        CGeneratorScheduler* scheduler;
+    };
+    mutable int         refCount;
+    bool                signaled;
+    std::vector<Waiter> waiters;
+};
+
+/** Cancellation token (cancellationToken in scripts): the generators bound to the 
+*   token are aborted when it is cancelled, or when the last reference to the token
+*   is released, so that generators can be bound to the scope of a token variable.
+*   A generator is bound to one token at most. Bound generators may be destroyed on
+*   any thread (executor workers): the bindings of all tokens are guarded by a single
+*   lock (which does not depend on the lifetime of a token), held while cancelling, so 
+*   that a generator cannot be destroyed while it is being aborted.
+*   Cancelling does not synchronize with the execution of the generators: the token 
+*   must not be cancelled (nor released) while its generators are run by another thread
+*   (such as executor workers), but only once they are completed.
+*/
+class CGeneratorCancellationToken
+{
+public:
+    CGeneratorCancellationToken();
+
+    // Memory management
+    int AddRef() const;
+    int Release() const;
+
+    // Binds a generator to the token (aborted immediately if already cancelled)
+    void Add(CGenerator* generator);
+    void Remove(CGenerator* generator);
+    // Aborts all bound generators
+    void Cancel();
+    bool IsCancelled() const;
+    asUINT GetCount() const;
+
+    // lock for the bindings of all tokens (recursive: aborting a generator may release
+    // other generators bound to the token)
+    static std::recursive_mutex& GetBindingsMutex();
+protected:
+    ~CGeneratorCancellationToken();
+
+    mutable int              refCount;
+    bool                     cancelled;
+    // bound generators (not referenced), guarded by GetBindingsMutex()
+    std::vector<CGenerator*> generators;
+};
+
+/** Block-rate adapter rendering the values of a generator as an audio-rate signal
+*   (blockAdapter in scripts). The generator gives the timing of its values in
+*   samples with waitUntilSample() and waitFor() (converted with the sample rate),
+*   for example: while (true) { yield(1.0); waitFor(250); yield(0.0); waitFor(250); }
+*   The generator is only resumed when a value changes: between values, the signal
+*   is either held (kSampleAndHold) or linearly interpolated towards the next value
+*   (kLinear, resuming the generator one value ahead). Values must be numeric.
+*/
+class CGeneratorBlockAdapter
+{
+public:
+    enum Interpolation
+    {
+        kSampleAndHold,
+        kLinear
+    };
+
+    CGeneratorBlockAdapter(CGenerator* generator, double sampleRate, Interpolation interpolation=kSampleAndHold);
+
+    // Memory management
+    int AddRef() const;
+    int Release() const;
+
+    // Renders the next numSamples samples of the signal. The number of resumes of the
+    // generator is bounded for each block: if the generator does not give its next
+    // value in time (or is preempted), the current value is held until the next block.
+    // Returns the number of samples written.
+    asUINT Fill(double* buffer, asUINT numSamples);
+    // same, resizing the array to numSamples (array<double>)
+    asUINT Fill(CScriptArray* values, asUINT numSamples);
+
+    void          SetInterpolation(Interpolation interpolation);
+    Interpolation GetInterpolation() const;
+    // sample position of the next block
+    asINT64       GetPosition() const;
+    // true when the generator is done (the last value is held)
+    bool          IsDone() const;
+    CGenerator*   GetGenerator() const;
+protected:
+    ~CGeneratorBlockAdapter();
+    // resumes the generator until its next value, bounded by maxResumes (decremented)
+    bool          PullNextValue(asUINT& maxResumes);
+
+    mutable int   refCount;
+    CGenerator*   generator;
+    double        sampleRate;
+    Interpolation interpolation;
+    asINT64       position;
+    bool          done;
+    // generator time in samples, advanced by its waits
+    double        generatorTime;
+    // current value (held, or start of the ramp) and the next value when known
+    bool          hasValue;
+    double        currentValue;
+    asINT64       currentTime;
+    bool          hasNextValue;
+    double        nextValue;
+    asINT64       nextTime;
+};
+
+/** Future value (future<T> in scripts) for asynchronous host operations: the host
+*   completes the future from any thread, and generators that await it are resumed
+*   by their scheduler, on its own thread, at the next tick after completion.
+*   Primitives and handles are stored inline, other objects are copied.
+*/
+class CGeneratorFuture
+{
+public:
+    // type is the future<T> template instance
+    CGeneratorFuture(asITypeInfo* type);
+
+    // Memory management
+    int AddRef() const;
+    int Release() const;
+
+    // Completes the future with a value (converted to T): can be called from any thread.
+    // Returns false if already completed or if the value cannot be converted.
+    bool Complete(void* ref, int refTypeId);
+    bool IsReady() const;
+    // address of the value of type T (the object itself for non-handle objects),
+    // NULL if not ready yet
+    const void* GetValue() const;
+    int GetValueTypeId() const;
+
+    // Waiters management (used by the scheduler). AddWaiter returns false if the 
+    // future is already completed.
+    bool AddWaiter(CGenerator* generator, CGeneratorScheduler* scheduler);
+    void RemoveWaiter(CGenerator* generator);
+protected:
+    ~CGeneratorFuture();
+
+    struct Waiter
+    {
+        CGenerator*          generator;
+        CGeneratorScheduler* scheduler;
+    };
+    mutable int         refCount;
+    asITypeInfo*        type;
+    int                 valueTypeId;
+    union
+    {
+        asINT64     i;
+        double      d;
+        void*       obj;
+    } value;
+    std::atomic<bool>   ready;
+    mutable std::mutex  mutex;
+    std::vector<Waiter> waiters;
+};
+
+/** Cooperative scheduler for generators: generators added to the scheduler are
+*   resumed round-robin by the host with Tick(), each at most once per tick,
+*   until the time budget or the max number of steps for the tick runs out.
+*   Finished generators are removed automatically. The next tick starts with
+*   the generators that were not resumed during the previous one.
+*   Generators that wait (waitFor / waitUntilSample) sleep in a timer wheel until
+*   the time set by the host with Advance() reaches their wake up time. 
+*   Generators that wait for an event are resumed when the event is signaled.
+*   Generators awaiting a future are resumed at the next tick after its completion.
+*   Generators added to a scheduler must not be resumed directly.
+*/
+class CGeneratorScheduler
+{
+    friend class CGeneratorEvent;
+    friend class CGeneratorFuture;
+public:
+    CGeneratorScheduler();
+    ~CGeneratorScheduler();
+
+    // Memory management
+    int AddRef() const;
+    int Release() const;
+
+    // Adds / removes a generator (the scheduler holds a reference to it)
+    void Add(CGenerator* generator);
+    void Remove(CGenerator* generator);
+    void Clear();
+
+    // Runs the generators for one tick. maxMicroseconds and maxSteps are the 
+    // budget for the tick (0 for no limit). Returns the number of steps executed.
+    asUINT Tick(asUINT maxMicroseconds, asUINT maxSteps=0);
+
+    // Aborts the generators whose abortAfter() timeout has expired without resuming 
+    // them: sleeping generators would otherwise keep their context until they wake up.
+    // Aborted sleeping generators are removed. Returns the number of aborted generators.
+    asUINT AbortExpired();
+
+    // Number of generators waiting to be resumed
+    asUINT GetReadyCount() const;
+    // Number of sleeping generators (waiting for some time or for an event)
+    asUINT GetSleepingCount() const;
+
+    // Time management: the time is counted in samples. The sample rate is used to
+    // convert durations given in milliseconds (default 1000: one sample per ms).
+    void    SetSampleRate(double sampleRate);
+    double  GetSampleRate() const;
+    // Advances the time: sleeping generators that are due are moved to the ready queue
+    void    Advance(asUINT numSamples);
+    asINT64 GetTime() const;
+
+    // Per-tick statistics
+    asUINT GetNumTicks() const;
+    asUINT GetNumOverruns() const;
+    double GetLastTickMicroseconds() const;
+    double GetLastOverrunMicroseconds() const;
+    double GetMaxOverrunMicroseconds() const;
+    void   ResetStatistics();
+protected:
+    // schedules a generator that is still running after a step
+    void Reschedule(CGenerator* generator);
+    // moves a generator waiting for an event to the ready queue
+    void Wake(CGenerator* generator);
+    // posts a generator awaiting a completed future (from any thread)
+    void PostFutureCompleted(CGenerator* generator);
+    // moves the generators with completed futures to the ready queue
+    void ProcessCompletedFutures();
+
+    mutable int             refCount;
+    std::deque<CGenerator*> readyQueue;
+    CGeneratorTimerWheel    timerWheel;
+    double                  sampleRate;
+    CGenerator*             eventWaiters;
+    asUINT                  numEventWaiters;
+    CGenerator*             futureWaiters;
+    asUINT                  numFutureWaiters;
+    std::mutex              completedFuturesMutex;
+    std::vector<CGenerator*> completedFutures;
+    std::vector<CGenerator*> completedFuturesSwap;
+    std::vector<CGenerator*> abortableGenerators;
+
+    asUINT  numTicks;
+    asUINT  numOverruns;
+    double  lastTickMicroseconds;
+    double  lastOverrunMicroseconds;
+    double  maxOverrunMicroseconds;
+};
+
+/** Multi-threaded executor for independent generators: submitted generators are
+*   run on a pool of worker threads until they are done, using work-stealing queues
+*   (a worker takes its most recent work first, and steals the oldest work of the 
+*   other workers when it runs out of it). Each worker has its own context pool for the
+*   generators created on the worker, and contexts are returned to the pool they were
+*   requested from: generators created on the workers must be released before the
+*   executor is destroyed. Generators are run by slices of a few steps, and completed 
+*   generators are handed back to the owning thread through PopCompleted() (script
+*   exceptions are kept by the generator: see CGenerator::GetExceptionString()).
+*   Generators must not share script objects with other threads while running. 
+*   Garbage is not collected on the workers: generators (and the generators they create)
+*   use the kGCDeferred policy of the executor, unless they have their own policy, which
+*   must then be kGCNever or kGCDeferred. The owning thread should collect garbage 
+*   (GetGCPolicy()->Collect(engine)) while generators run or once they are completed.
+*   AngelScript must be built with multithreading support.
+*/
+class CGeneratorExecutor
+{
+public:
+    // numWorkers: number of worker threads (0 for the number of hardware threads)
+    // contextPoolSize: size of the context pool of each worker (0 for no pool)
+    // stepsPerSlice: number of generator steps run before the generator is requeued
+    CGeneratorExecutor(asIScriptEngine* engine, asUINT numWorkers=0, asUINT contextPoolSize=4, asUINT stepsPerSlice=64);
+    // Stops the workers (generators still queued are released without completing)
+    ~CGeneratorExecutor();
+
+    // Runs the generator on the workers (the executor holds a reference to it)
+    void Submit(CGenerator* generator);
+
+    // Returns the next completed generator, or NULL if none. 
+    // To be called by the owning thread, which gets the reference (must release it).
+    CGenerator* PopCompleted();
+
+    // Blocks until all submitted generators are completed
+    void WaitAll();
+
+    asUINT GetNumWorkers() const;
+    asUINT GetNumPending() const;
+    asUINT GetNumSteals() const;
+    // deferred GC policy of the generators run on the workers
+    CGeneratorGCPolicy* GetGCPolicy();
+protected:
+    struct Worker
+    {
+        std::thread             thread;
+        std::mutex              mutex;
+        std::deque<CGenerator*> queue;
+        // pool of the generators created on the worker (owned)
+        CGeneratorContextPool*  contextPool;
+    };
+    void        Run(asUINT index);
+    CGenerator* PopWork(asUINT index);
+    // requeued: unfinished generator after a slice, queued behind the other work of the
+    // worker (so that slices rotate), instead of being picked again right away
+    void        PushWork(asUINT index, CGenerator* generator, bool requeued=false);
+
+    asIScriptEngine*        engine;
+    CGeneratorGCPolicy      gcPolicy;
+    asUINT                  stepsPerSlice;
+    std::vector<Worker*>    workers;
+    std::atomic<asUINT>     nextWorker;
+    std::atomic<asUINT>     numQueued;
+    std::atomic<asUINT>     numPending;
+    std::atomic<asUINT>     numSteals;
+    std::atomic<bool>       stopping;
+
+    // sleeping workers wait for work or stop
+    std::mutex              workMutex;
+    std::condition_variable workCondition;
+
+    // completed generators, waiting for the owning thread
+    std::mutex              completedMutex;
+    std::condition_variable completedCondition;
+    std::deque<CGenerator*> completed;
+};
 
 // Registers the following:
 //
 //  funcdef void generator(dictionary@)
 //  void generator@ createGenerator(generatorFunc @func, dictionary @args)
+//  generator@ createGenerator(?&in func, ?&in arg1, ...): func is a handle to any funcdef
+//   (function or delegate), called with up to 4 arguments (also for typedGenerator<T>)
 //  void yield()
-void RegisterGeneratorSupport(asIScriptEngine *engine);
+//  void yieldFrom(generator@): forwards all values of another generator (or typedGenerator<T>)
+//  void waitFor(double ms), void waitUntilSample(int64 pos): sleep in the scheduler
+//  event: event object with signal(), reset(), isSet and wait() (in generators)
+//  future<T>: future value with complete(), isReady and value, void await(future<T>@) in generators
+//  typedGenerator<T>: typed generator, created with typedGenerator<T>(generatorFunc @func, dictionary @args)
+//  generatorScheduler: scheduler object created by the host, with add(), remove() and readyCount
+//  generator.setQuota(uint lines, double us), generator.preempted: preemption of long running steps
+//  generator.map(), filter(), take(), skip(), zip(), chain(), window(): native lazy combinators,
+//   with funcdefs generatorMapFunc, generatorFilterFunc and generatorZipFunc
+//  foreach (generator and typedGenerator<T>): opForBegin, opForEnd, opForNext and opForValue
+//  generator.abort(), abortAfter(double ms), aborted: cancellation of generators
+//  cancellationToken: cancel(), isCancelled, add(generator) and remove(generator), cancelled when released
+//  blockAdapter(generator, double sampleRate, bool linear=false): audio-rate rendering of the
+//   values of a generator with uint fill(array<double>&, uint numSamples), position, done and linear
+//  generatorStats: execution statistics, from generator.stats or getGeneratorStats() for the engine
+//
+// If contextPoolSize is not zero, a context pool dedicated to generators is created
+// with contextPoolSize contexts created up front (the engine context callbacks are
+// used otherwise), to be warmed up with GetGeneratorContextPool(engine)->Warmup(func) 
+// once the scripts are built. The pooled contexts hold a reference to the engine: the
+// host must call ShutdownGeneratorSupport before releasing the engine.
+void RegisterGeneratorSupport(asIScriptEngine *engine, asUINT contextPoolSize=0);
+
+// Installs engine memory functions that attribute the memory allocated and freed while
+// a generator runs to this generator (see CGenerator::GetMemoryStats). Like 
+// asSetGlobalMemoryFunctions, must be called before any engine is created. allocFunc 
+// and freeFunc are the underlying memory functions (NULL for malloc and free).
+int EnableGeneratorMemoryAccounting(asALLOCFUNC_t allocFunc=NULL, asFREEFUNC_t freeFunc=NULL);
+
+// Returns the generator context pool for this engine (NULL if none)
+CGeneratorContextPool* GetGeneratorContextPool(asIScriptEngine *engine);
+
+// Sets the arena used by the createGenerator(?&in func, ...) overloads on the current
+// thread (NULL to allocate generators on the heap). When the arena is full, these
+// return a null handle. Not owned.
+void SetGeneratorArenaForThread(CGeneratorArena* arena);
+
+// Sets the garbage collection policy used by generators that do not have their
+// own policy (NULL to restore the default kGCFullCycle policy). Not owned by the engine.
+void SetGeneratorGCPolicy(asIScriptEngine *engine, CGeneratorGCPolicy* policy);
+CGeneratorGCPolicy* GetGeneratorGCPolicy(asIScriptEngine *engine);
+
+// Returns the statistics for all the generators of the engine since registration
+// (or last reset). Statistics are gathered once enabled (disabled by default), 
+// including timing statistics for all the generators of the engine.
+SGeneratorStats GetGeneratorEngineStats(asIScriptEngine *engine);
+void ResetGeneratorEngineStats(asIScriptEngine *engine);
+void EnableGeneratorStats(asIScriptEngine *engine, bool enable);
+
+// Releases the contexts held by the generator context pool. Must be called before
+// shutting down the engine if a context pool was requested at registration, as 
+// pooled contexts hold a reference to the engine.
+void ShutdownGeneratorSupport(asIScriptEngine *engine);
 
 END_AS_NAMESPACE
 